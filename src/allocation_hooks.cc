@@ -0,0 +1,130 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "stats.h"
+
+// The global operator new / delete behind Stats' allocation counters. They are
+// linked into lox-cpp only, so a program embedding the lox library keeps its
+// own allocator (and its reports count no allocations).
+namespace
+{
+// the bytes malloc really set aside for a block, which it knows without a
+// header of ours in front of every allocation
+size_t BlockSize(void *block)
+{
+#if defined(__APPLE__)
+    return malloc_size(block);
+#elif defined(_WIN32)
+    return _msize(block);
+#else
+    return malloc_usable_size(block);
+#endif
+}
+
+// Blocks are counted in and out while tracking is on. A block allocated
+// before tracking started and freed after only lowers the live byte count;
+// --stats turns tracking on before anything is run.
+void *Allocate(size_t size)
+{
+    void *block = std::malloc(size);
+    if (block != nullptr && lox::Stats::tracking())
+    {
+        lox::Stats::RecordAllocation(BlockSize(block));
+    }
+    return block;
+}
+
+void Deallocate(void *ptr)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+    if (lox::Stats::tracking())
+    {
+        lox::Stats::RecordDeallocation(BlockSize(ptr));
+    }
+    std::free(ptr);
+}
+
+void *AllocateOrThrow(size_t size)
+{
+    while (true)
+    {
+        void *ptr = Allocate(size);
+        if (ptr != nullptr)
+        {
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+} // namespace
+
+// libstdc++ on MinGW lives in a DLL whose own allocations would bypass the
+// replaced operators, so allocations go untracked there
+#ifndef __MINGW32__
+
+void *operator new(size_t size)
+{
+    return AllocateOrThrow(size);
+}
+
+void *operator new[](size_t size)
+{
+    return AllocateOrThrow(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return Allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return Allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    Deallocate(ptr);
+}
+
+#endif
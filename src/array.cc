@@ -0,0 +1,174 @@
+#include "array.h"
+
+#include <cmath>
+
+#include "array_simd.h"
+#include "callable.h"
+#include "environment.h"
+#include "error.h"
+#include "interpreter.h"
+
+namespace lox
+{
+namespace
+{
+Array *ArrayArgument(const std::vector<Object> &arguments, size_t index, const char *function)
+{
+    if (!IsObjectInstance<ArrayPtr>(arguments.at(index)))
+    {
+        throw NativeError(std::string(function) + "() expects an array.");
+    }
+    return std::get<ArrayPtr>(arguments.at(index));
+}
+
+double NumberArgument(const std::vector<Object> &arguments, size_t index, const char *function)
+{
+    if (!IsObjectInstance<double>(arguments.at(index)))
+    {
+        throw NativeError(std::string(function) + "() expects a number.");
+    }
+    return std::get<double>(arguments.at(index));
+}
+
+// arrays the bulk natives combine element by element
+std::pair<Array *, Array *> ArrayPair(const std::vector<Object> &arguments, const char *function)
+{
+    Array *a = ArrayArgument(arguments, 0, function);
+    Array *b = ArrayArgument(arguments, 1, function);
+    if (a->values().size() != b->values().size())
+    {
+        throw NativeError(std::string(function) + "() expects arrays of the same length.");
+    }
+    return {a, b};
+}
+
+Object ArrayFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    double size = NumberArgument(arguments, 0, "newArray");
+    if (!(size >= 0.0 && size <= static_cast<double>(UINT32_MAX)) || std::floor(size) != size)
+    {
+        throw NativeError("newArray() expects a whole, non-negative size.");
+    }
+    double fill = NumberArgument(arguments, 1, "newArray");
+    return interpreter->heap().Allocate<Array>(std::vector<double>(static_cast<size_t>(size), fill));
+}
+
+Object LenFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    return static_cast<double>(ArrayArgument(arguments, 0, "arrayLen")->values().size());
+}
+
+Object GetFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    std::vector<double> &values = ArrayArgument(arguments, 0, "arrayGet")->values();
+    return values[IndexArgument(arguments, 1, values.size(), "arrayGet")];
+}
+
+Object SetFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    std::vector<double> &values = ArrayArgument(arguments, 0, "arraySet")->values();
+    double value = NumberArgument(arguments, 2, "arraySet");
+    values[IndexArgument(arguments, 1, values.size(), "arraySet")] = value;
+    return value;
+}
+
+Object SumFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    const std::vector<double> &values = ArrayArgument(arguments, 0, "arraySum")->values();
+    return ArrayKernels::Get().sum(values.data(), values.size());
+}
+
+Object DotFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    auto [a, b] = ArrayPair(arguments, "arrayDot");
+    return ArrayKernels::Get().dot(a->values().data(), b->values().data(), a->values().size());
+}
+
+Object MinFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    const std::vector<double> &values = ArrayArgument(arguments, 0, "arrayMin")->values();
+    if (values.empty())
+    {
+        throw NativeError("arrayMin() of an empty array.");
+    }
+    return ArrayKernels::Get().min(values.data(), values.size());
+}
+
+Object MaxFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    const std::vector<double> &values = ArrayArgument(arguments, 0, "arrayMax")->values();
+    if (values.empty())
+    {
+        throw NativeError("arrayMax() of an empty array.");
+    }
+    return ArrayKernels::Get().max(values.data(), values.size());
+}
+
+Object ScaleFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    Array *array = ArrayArgument(arguments, 0, "arrayScale");
+    double factor = NumberArgument(arguments, 1, "arrayScale");
+    ArrayKernels::Get().scale(array->values().data(), array->values().size(), factor);
+    return array;
+}
+
+Object AddFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    auto [a, b] = ArrayPair(arguments, "arrayAdd");
+    ArrayKernels::Get().add(a->values().data(), b->values().data(), a->values().size());
+    return a;
+}
+
+Object PrefixSumFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    Array *array = ArrayArgument(arguments, 0, "arrayPrefixSum");
+    ArrayKernels::Get().prefix_sum(array->values().data(), array->values().size());
+    return array;
+}
+} // namespace
+
+std::string Array::ToString() const
+{
+    std::string str = "[";
+    for (size_t i = 0; i < values_.size(); i++)
+    {
+        if (i > 0)
+        {
+            str += ", ";
+        }
+        AppendNumber(str, values_[i]);
+    }
+    str += "]";
+    return str;
+}
+
+size_t IndexArgument(const std::vector<Object> &arguments, size_t index, size_t size, const char *function)
+{
+    double value = NumberArgument(arguments, index, function);
+    if (!(value >= 0.0 && value < static_cast<double>(size)) || std::floor(value) != value)
+    {
+        throw NativeError(std::string(function) + "() index out of range.");
+    }
+    return static_cast<size_t>(value);
+}
+
+void DefineArrayFunctions(Heap *heap, Environment *globals)
+{
+    struct Native
+    {
+        const char *name;
+        Object (*func)(Interpreter *, const std::vector<Object> &);
+        int arity;
+    };
+    static const Native kNatives[] = {
+        {"newArray", ArrayFunc, 2},     {"arrayLen", LenFunc, 1},    {"arrayGet", GetFunc, 2},
+        {"arraySet", SetFunc, 3},       {"arraySum", SumFunc, 1},    {"arrayDot", DotFunc, 2},
+        {"arrayMin", MinFunc, 1},       {"arrayMax", MaxFunc, 1},    {"arrayScale", ScaleFunc, 2},
+        {"arrayAdd", AddFunc, 2},       {"arrayPrefixSum", PrefixSumFunc, 1},
+    };
+    for (const Native &native : kNatives)
+    {
+        globals->Define(native.name, heap->Allocate<BuiltinCallable>(native.name, native.func, native.arity));
+    }
+}
+} // namespace lox
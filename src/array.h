@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gc.h"
+#include "object.h"
+
+namespace lox
+{
+class Environment;
+
+// Fixed-size contiguous array of numbers. It holds no references, so the
+// collector never traces into it and stores need no write barrier.
+class Array : public GcObject
+{
+  public:
+    explicit Array(std::vector<double> values) : values_(std::move(values)) {}
+
+    std::vector<double> &values()
+    {
+        return values_;
+    }
+
+    const std::vector<double> &values() const
+    {
+        return values_;
+    }
+
+    // [1, 2, 3]
+    std::string ToString() const;
+
+    size_t HeapSize() const override
+    {
+        return sizeof(Array) + values_.capacity() * sizeof(double);
+    }
+
+  private:
+    std::vector<double> values_;
+};
+
+// Defines the array natives in `globals`, named after the type so that a
+// script's own names do not hide them:
+//
+//   newArray(size, fill)  a new array of `size` copies of `fill`
+//   arrayLen(a), arrayGet(a, i), arraySet(a, i, value)
+//   arraySum(a), arrayDot(a, b), arrayMin(a), arrayMax(a)
+//   arrayScale(a, factor), arrayAdd(a, b), arrayPrefixSum(a)
+//
+// The last three update `a` in place and return it. The bulk ones run the
+// ArrayKernels, so a whole array costs one call instead of one interpreted
+// loop iteration per element.
+void DefineArrayFunctions(Heap *heap, Environment *globals);
+
+// the argument at `index` of a native, checked to be a whole number in [0, size)
+size_t IndexArgument(const std::vector<Object> &arguments, size_t index, size_t size, const char *function);
+} // namespace lox
@@ -0,0 +1,335 @@
+#include "array_simd.h"
+
+#include "cpu.h"
+
+#ifdef LOX_X86
+#include <immintrin.h>
+#endif
+
+namespace lox
+{
+namespace
+{
+// scalar versions, also used for the tails shorter than one vector
+
+double SumScalar(const double *p, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += p[i];
+    }
+    return sum;
+}
+
+double DotScalar(const double *a, const double *b, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void ScaleScalar(double *p, size_t n, double factor)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] *= factor;
+    }
+}
+
+void AddScalar(double *a, const double *b, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        a[i] += b[i];
+    }
+}
+
+// folds p[0, n) into `init`; the comparisons match _mm_min_pd / _mm_max_pd
+double MinScalar(const double *p, size_t n, double init)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        init = p[i] < init ? p[i] : init;
+    }
+    return init;
+}
+
+double MaxScalar(const double *p, size_t n, double init)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        init = p[i] > init ? p[i] : init;
+    }
+    return init;
+}
+
+double MinScalar(const double *p, size_t n)
+{
+    return MinScalar(p + 1, n - 1, p[0]);
+}
+
+double MaxScalar(const double *p, size_t n)
+{
+    return MaxScalar(p + 1, n - 1, p[0]);
+}
+
+void PrefixSumScalar(double *p, size_t n, double carry)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        carry += p[i];
+        p[i] = carry;
+    }
+}
+
+void PrefixSumScalar(double *p, size_t n)
+{
+    PrefixSumScalar(p, n, 0.0);
+}
+
+#ifdef LOX_X86
+
+// Unlike the scanner's kernels these keep values in registers across the
+// whole loop, so each ISA has its own loops rather than shared templates
+// calling out to per-ISA helpers.
+
+// SSE2: two doubles per vector, sums unrolled twice to hide the add latency
+
+double SumSse2(const double *p, size_t n)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sum0 = _mm_add_pd(sum0, _mm_loadu_pd(p + i));
+        sum1 = _mm_add_pd(sum1, _mm_loadu_pd(p + i + 2));
+    }
+    __m128d sum = _mm_add_pd(sum0, sum1);
+    return _mm_cvtsd_f64(sum) + _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum)) + SumScalar(p + i, n - i);
+}
+
+double DotSse2(const double *a, const double *b, size_t n)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    __m128d sum = _mm_add_pd(sum0, sum1);
+    return _mm_cvtsd_f64(sum) + _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum)) + DotScalar(a + i, b + i, n - i);
+}
+
+void ScaleSse2(double *p, size_t n, double factor)
+{
+    __m128d f = _mm_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_storeu_pd(p + i, _mm_mul_pd(_mm_loadu_pd(p + i), f));
+    }
+    ScaleScalar(p + i, n - i, factor);
+}
+
+void AddSse2(double *a, const double *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    AddScalar(a + i, b + i, n - i);
+}
+
+double MinSse2(const double *p, size_t n)
+{
+    if (n < 2)
+    {
+        return MinScalar(p, n);
+    }
+    __m128d m = _mm_loadu_pd(p);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        m = _mm_min_pd(_mm_loadu_pd(p + i), m);
+    }
+    double low = _mm_cvtsd_f64(m);
+    double high = _mm_cvtsd_f64(_mm_unpackhi_pd(m, m));
+    return MinScalar(p + i, n - i, high < low ? high : low);
+}
+
+double MaxSse2(const double *p, size_t n)
+{
+    if (n < 2)
+    {
+        return MaxScalar(p, n);
+    }
+    __m128d m = _mm_loadu_pd(p);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+    {
+        m = _mm_max_pd(_mm_loadu_pd(p + i), m);
+    }
+    double low = _mm_cvtsd_f64(m);
+    double high = _mm_cvtsd_f64(_mm_unpackhi_pd(m, m));
+    return MaxScalar(p + i, n - i, high > low ? high : low);
+}
+
+// in-register scan of each vector, then the running total of the previous
+// vectors added to all lanes
+void PrefixSumSse2(double *p, size_t n)
+{
+    __m128d carry = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d v = _mm_loadu_pd(p + i);
+        v = _mm_add_pd(v, _mm_unpacklo_pd(_mm_setzero_pd(), v));
+        v = _mm_add_pd(v, carry);
+        _mm_storeu_pd(p + i, v);
+        carry = _mm_unpackhi_pd(v, v);
+    }
+    PrefixSumScalar(p + i, n - i, _mm_cvtsd_f64(carry));
+}
+
+// AVX2: four doubles per vector
+
+LOX_TARGET_AVX2 double HorizontalSum(__m256d v)
+{
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+LOX_TARGET_AVX2 double SumAvx2(const double *p, size_t n)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(p + i));
+        sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(p + i + 4));
+    }
+    return HorizontalSum(_mm256_add_pd(sum0, sum1)) + SumScalar(p + i, n - i);
+}
+
+LOX_TARGET_AVX2 double DotAvx2(const double *a, const double *b, size_t n)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    return HorizontalSum(_mm256_add_pd(sum0, sum1)) + DotScalar(a + i, b + i, n - i);
+}
+
+LOX_TARGET_AVX2 void ScaleAvx2(double *p, size_t n, double factor)
+{
+    __m256d f = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(p + i, _mm256_mul_pd(_mm256_loadu_pd(p + i), f));
+    }
+    ScaleScalar(p + i, n - i, factor);
+}
+
+LOX_TARGET_AVX2 void AddAvx2(double *a, const double *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    AddScalar(a + i, b + i, n - i);
+}
+
+LOX_TARGET_AVX2 double MinAvx2(const double *p, size_t n)
+{
+    if (n < 4)
+    {
+        return MinScalar(p, n);
+    }
+    __m256d m = _mm256_loadu_pd(p);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        m = _mm256_min_pd(_mm256_loadu_pd(p + i), m);
+    }
+    __m128d half = _mm_min_pd(_mm256_extractf128_pd(m, 1), _mm256_castpd256_pd128(m));
+    double low = _mm_cvtsd_f64(half);
+    double high = _mm_cvtsd_f64(_mm_unpackhi_pd(half, half));
+    return MinScalar(p + i, n - i, high < low ? high : low);
+}
+
+LOX_TARGET_AVX2 double MaxAvx2(const double *p, size_t n)
+{
+    if (n < 4)
+    {
+        return MaxScalar(p, n);
+    }
+    __m256d m = _mm256_loadu_pd(p);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        m = _mm256_max_pd(_mm256_loadu_pd(p + i), m);
+    }
+    __m128d half = _mm_max_pd(_mm256_extractf128_pd(m, 1), _mm256_castpd256_pd128(m));
+    double low = _mm_cvtsd_f64(half);
+    double high = _mm_cvtsd_f64(_mm_unpackhi_pd(half, half));
+    return MaxScalar(p + i, n - i, high > low ? high : low);
+}
+
+LOX_TARGET_AVX2 void PrefixSumAvx2(double *p, size_t n)
+{
+    __m256d zero = _mm256_setzero_pd();
+    __m256d carry = zero;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d v = _mm256_loadu_pd(p + i);
+        // [a, b, c, d] + [0, a, b, c], then + [0, 0, a, a+b]
+        v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+        v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+        v = _mm256_add_pd(v, carry);
+        _mm256_storeu_pd(p + i, v);
+        carry = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    PrefixSumScalar(p + i, n - i, _mm256_cvtsd_f64(carry));
+}
+
+#endif
+
+ArrayKernels Select()
+{
+#ifdef LOX_X86
+    const CpuFeatures &features = GetCpuFeatures();
+    if (features.avx2)
+    {
+        return {SumAvx2, DotAvx2, ScaleAvx2, AddAvx2, MinAvx2, MaxAvx2, PrefixSumAvx2};
+    }
+    if (features.sse2)
+    {
+        return {SumSse2, DotSse2, ScaleSse2, AddSse2, MinSse2, MaxSse2, PrefixSumSse2};
+    }
+#endif
+    return {SumScalar, DotScalar, ScaleScalar, AddScalar, MinScalar, MaxScalar, PrefixSumScalar};
+}
+} // namespace
+
+const ArrayKernels &ArrayKernels::Get()
+{
+    static const ArrayKernels kernels = Select();
+    return kernels;
+}
+} // namespace lox
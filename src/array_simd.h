@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace lox
+{
+// Bulk kernels behind the array natives. Get() picks the AVX2, SSE2 or scalar
+// versions once, based on what the CPU supports. The vector versions keep
+// several partial sums, so sum, dot and prefix_sum may round differently
+// from the scalar ones in the last bits.
+struct ArrayKernels
+{
+    double (*sum)(const double *p, size_t n);
+    double (*dot)(const double *a, const double *b, size_t n);
+    // p[i] *= factor
+    void (*scale)(double *p, size_t n, double factor);
+    // a[i] += b[i]
+    void (*add)(double *a, const double *b, size_t n);
+    // n must not be 0
+    double (*min)(const double *p, size_t n);
+    double (*max)(const double *p, size_t n);
+    // inclusive running total, in place
+    void (*prefix_sum)(double *p, size_t n);
+
+    static const ArrayKernels &Get();
+};
+} // namespace lox
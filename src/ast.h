@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "object.h"
@@ -16,14 +18,157 @@ class Expr;
 namespace stmt
 {
 class Stmt;
+class Function;
 }
 
 using ExprUniquePtr = std::unique_ptr<expr::Expr>;
 using StmtUniquePtr = std::unique_ptr<stmt::Stmt>;
+using FunctionUniquePtr = std::unique_ptr<stmt::Function>;
 using ExprList = std::vector<ExprUniquePtr>;
 using StmtList = std::vector<StmtUniquePtr>;
 using Program = std::vector<StmtUniquePtr>;
 
+// Where a variable lives at runtime, filled in by the Resolver: a global looked
+// up by name, a slot of the current call frame, a heap cell of the current frame
+// (for locals some closure captures) or one of the running closure's upvalues.
+struct VariableSlot
+{
+    enum class Kind : uint8_t
+    {
+        kGlobal,
+        kLocal,
+        kCell,
+        kUpvalue,
+    };
+
+    Kind kind = Kind::kGlobal;
+    uint32_t index = 0;
+};
+
+// how a closure captures one variable when it is created: a cell of the
+// enclosing frame, or an upvalue of the enclosing closure
+struct UpvalueSource
+{
+    bool from_cell = true;
+    uint32_t index = 0;
+};
+
+class Shape;
+class UserDefineCallable;
+
+// Inline cache of one property access site. Each
+// entry maps the shape of an instance seen here to where the property was:
+// a field slot, or a method of the shape's class. A set of a new field also
+// records the shape the instance moves to. One entry is the monomorphic case;
+// once all entries are taken the site stops caching and does full lookups.
+struct PropertyCache
+{
+    static constexpr size_t kEntries = 4;
+
+    struct Entry
+    {
+        // Shape::id(), never reused, so an entry can't outlive its shape's meaning
+        uint32_t shape = 0;
+        uint32_t slot = 0;
+        UserDefineCallable *method = nullptr;
+        Shape *transition = nullptr;
+    };
+
+    const Entry *Find(uint32_t shape) const
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            if (entries[i].shape == shape)
+            {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void Add(const Entry &entry)
+    {
+        if (size < kEntries)
+        {
+            entries[size++] = entry;
+        }
+    }
+
+    Entry entries[kEntries];
+    size_t size = 0;
+    // PropertySite::generation() of the site the entries were found for
+    uint32_t generation = 0;
+};
+
+// Number of a property access site, unique among the live nodes of the
+// process. The caches live in each Interpreter, indexed by site, so that once
+// resolved a tree is never written again and can be run by several
+// interpreters at once. A freed node gives its number back, which keeps the
+// numbers as dense as the live trees in a process that compiles scripts for
+// as long as it runs; the number's generation changes each time it is handed
+// out, so a cache filled for an earlier owner is recognized and dropped.
+class PropertySite
+{
+  public:
+    PropertySite()
+    {
+        Registry &registry = Sites();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.free.empty())
+        {
+            index_ = static_cast<uint32_t>(registry.generations.size());
+            registry.generations.push_back(0);
+        }
+        else
+        {
+            index_ = registry.free.back();
+            registry.free.pop_back();
+        }
+        generation_ = registry.generations[index_];
+    }
+
+    ~PropertySite()
+    {
+        Registry &registry = Sites();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.generations[index_]++;
+        registry.free.push_back(index_);
+    }
+
+    PropertySite(const PropertySite &) = delete;
+    PropertySite &operator=(const PropertySite &) = delete;
+
+    uint32_t index() const
+    {
+        return index_;
+    }
+
+    uint32_t generation() const
+    {
+        return generation_;
+    }
+
+  private:
+    struct Registry
+    {
+        std::mutex mutex;
+        // the generation the next owner of each number gets
+        std::vector<uint32_t> generations;
+        std::vector<uint32_t> free;
+    };
+
+    // never destroyed: trees held by other statics may be freed after it would be
+    static Registry &Sites()
+    {
+        static Registry *registry = new Registry;
+        return *registry;
+    }
+
+  private:
+    uint32_t index_;
+    uint32_t generation_;
+};
+
 namespace expr
 {
 class Binary;
@@ -34,6 +179,10 @@ class Unary;
 class Variable;
 class Assign;
 class Call;
+class Get;
+class Set;
+class This;
+class Super;
 
 class ExprVisitor
 {
@@ -46,6 +195,10 @@ class ExprVisitor
     virtual Object Visit(Assign *expr) = 0;
     virtual Object Visit(Logical *expr) = 0;
     virtual Object Visit(Call *expr) = 0;
+    virtual Object Visit(Get *expr) = 0;
+    virtual Object Visit(Set *expr) = 0;
+    virtual Object Visit(This *expr) = 0;
+    virtual Object Visit(Super *expr) = 0;
 };
 
 class Expr
@@ -195,8 +348,14 @@ class Variable : public Expr
         return name_;
     }
 
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
   private:
     Token name_;
+    VariableSlot slot_;
 };
 
 class Assign : public Expr
@@ -219,16 +378,163 @@ class Assign : public Expr
         return name_;
     }
 
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
   private:
     Token name_;
+    VariableSlot slot_;
     ExprUniquePtr value_;
 };
 
+class Get : public Expr
+{
+  public:
+    Get(ExprUniquePtr object, const Token &name) : object_(std::move(object)), name_(name) {}
+
+    Object Accept(ExprVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    Expr *object()
+    {
+        return object_.get();
+    }
+
+    // for the parser, when the Get turns out to be an assignment target
+    ExprUniquePtr release_object()
+    {
+        return std::move(object_);
+    }
+
+    const Token &name()
+    {
+        return name_;
+    }
+
+    const PropertySite &site() const
+    {
+        return site_;
+    }
+
+  private:
+    ExprUniquePtr object_;
+    Token name_;
+    PropertySite site_;
+};
+
+class Set : public Expr
+{
+  public:
+    Set(ExprUniquePtr object, const Token &name, ExprUniquePtr value)
+        : object_(std::move(object)), name_(name), value_(std::move(value))
+    {
+    }
+
+    Object Accept(ExprVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    Expr *object()
+    {
+        return object_.get();
+    }
+
+    const Token &name()
+    {
+        return name_;
+    }
+
+    Expr *value()
+    {
+        return value_.get();
+    }
+
+    const PropertySite &site() const
+    {
+        return site_;
+    }
+
+  private:
+    ExprUniquePtr object_;
+    Token name_;
+    ExprUniquePtr value_;
+    PropertySite site_;
+};
+
+class This : public Expr
+{
+  public:
+    This(const Token &keyword) : keyword_(keyword) {}
+
+    Object Accept(ExprVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    const Token &keyword()
+    {
+        return keyword_;
+    }
+
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
+  private:
+    Token keyword_;
+    VariableSlot slot_;
+};
+
+class Super : public Expr
+{
+  public:
+    Super(const Token &keyword, const Token &method) : keyword_(keyword), method_(method) {}
+
+    Object Accept(ExprVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    const Token &keyword()
+    {
+        return keyword_;
+    }
+
+    const Token &method()
+    {
+        return method_;
+    }
+
+    // the superclass, bound around the methods of the class declaring it
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
+    VariableSlot &this_slot()
+    {
+        return this_slot_;
+    }
+
+  private:
+    Token keyword_;
+    Token method_;
+    VariableSlot slot_;
+    VariableSlot this_slot_;
+};
+
 class Call : public Expr
 {
   public:
     Call(ExprUniquePtr callee, const Token &paren, ExprList arguments)
-        : callee_(std::move(callee)), paren_(paren), arguments_(std::move(arguments))
+        : callee_(std::move(callee)), paren_(paren), arguments_(std::move(arguments)),
+          method_(dynamic_cast<Get *>(callee_.get()))
     {
     }
 
@@ -252,10 +558,17 @@ class Call : public Expr
         return arguments_;
     }
 
+    // the callee when it is a property, so `a.b()` can call a method without binding it first
+    Get *method()
+    {
+        return method_;
+    }
+
   private:
     ExprUniquePtr callee_;
     Token paren_;
     ExprList arguments_;
+    Get *method_;
 };
 } // namespace expr
 
@@ -269,6 +582,8 @@ class If;
 class While;
 class Function;
 class Return;
+class Class;
+class Import;
 
 class StmtVisitor
 {
@@ -281,6 +596,8 @@ class StmtVisitor
     virtual Object Visit(While *stmt) = 0;
     virtual Object Visit(Function *stmt) = 0;
     virtual Object Visit(Return *stmt) = 0;
+    virtual Object Visit(Class *stmt) = 0;
+    virtual Object Visit(Import *stmt) = 0;
 };
 
 class Stmt
@@ -347,8 +664,14 @@ class Var : public Stmt
         return name_;
     }
 
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
   private:
     Token name_;
+    VariableSlot slot_;
     ExprUniquePtr initializer_;
 };
 
@@ -433,7 +756,7 @@ class Function : public Stmt
 {
   public:
     Function(const Token &name, const std::vector<Token> &params, StmtUniquePtr body)
-        : name_(name), params_(params), body_(std::move(body))
+        : name_(name), params_(params), param_slots_(params.size()), body_(std::move(body))
     {
     }
 
@@ -457,9 +780,36 @@ class Function : public Stmt
         return body_.get();
     }
 
+    // the variable the function is bound to
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
+    std::vector<VariableSlot> &param_slots()
+    {
+        return param_slots_;
+    }
+
+    // what a closure of this function captures, in upvalue order
+    std::vector<UpvalueSource> &upvalues()
+    {
+        return upvalues_;
+    }
+
+    // methods only: where the receiver is bound on entry
+    VariableSlot &this_slot()
+    {
+        return this_slot_;
+    }
+
   private:
     Token name_;
+    VariableSlot slot_;
+    VariableSlot this_slot_;
     std::vector<Token> params_;
+    std::vector<VariableSlot> param_slots_;
+    std::vector<UpvalueSource> upvalues_;
     StmtUniquePtr body_;
 };
 
@@ -482,5 +832,84 @@ class Return : public Stmt
     ExprUniquePtr value_;
 };
 
+class Class : public Stmt
+{
+  public:
+    Class(const Token &name, std::unique_ptr<expr::Variable> superclass, std::vector<FunctionUniquePtr> methods)
+        : name_(name), superclass_(std::move(superclass)), methods_(std::move(methods))
+    {
+    }
+
+    Object Accept(StmtVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    const Token &name()
+    {
+        return name_;
+    }
+
+    expr::Variable *superclass()
+    {
+        return superclass_.get();
+    }
+
+    const std::vector<FunctionUniquePtr> &methods()
+    {
+        return methods_;
+    }
+
+    VariableSlot &slot()
+    {
+        return slot_;
+    }
+
+    // the `super` variable its methods capture, when there is a superclass
+    VariableSlot &super_slot()
+    {
+        return super_slot_;
+    }
+
+  private:
+    Token name_;
+    VariableSlot slot_;
+    VariableSlot super_slot_;
+    std::unique_ptr<expr::Variable> superclass_;
+    std::vector<FunctionUniquePtr> methods_;
+};
+
+// import "path"; allowed at the top level only, see modules.h
+class Import : public Stmt
+{
+  public:
+    Import(const Token &keyword, const Token &path) : keyword_(keyword), path_(path) {}
+
+    Object Accept(StmtVisitor *visitor) override
+    {
+        return visitor->Visit(this);
+    }
+
+    const Token &keyword()
+    {
+        return keyword_;
+    }
+
+    // the path as written, relative to the importing file
+    std::string path()
+    {
+        return std::get<std::string>(path_.literal());
+    }
+
+    const Token &path_token()
+    {
+        return path_;
+    }
+
+  private:
+    Token keyword_;
+    Token path_;
+};
+
 } // namespace stmt
 } // namespace lox
\ No newline at end of file
@@ -0,0 +1,707 @@
+#include "ast_serializer.h"
+
+#include <cstring>
+
+using namespace lox;
+using namespace lox::expr;
+using namespace lox::stmt;
+
+namespace
+{
+enum class NodeTag : uint8_t
+{
+    kNull,
+    kBinary,
+    kGrouping,
+    kLiteral,
+    kUnary,
+    kVariable,
+    kAssign,
+    kLogical,
+    kCall,
+    kExpression,
+    kPrint,
+    kVar,
+    kBlock,
+    kIf,
+    kWhile,
+    kFunction,
+    kReturn,
+    kGet,
+    kSet,
+    kThis,
+    kSuper,
+    kClass,
+    kImport,
+};
+
+enum class ValueTag : uint8_t
+{
+    kNil,
+    kNumber,
+    kFalse,
+    kTrue,
+    kString,
+};
+
+} // namespace
+
+namespace lox
+{
+std::string AstSerializer::Serialize(const Program &program)
+{
+    WriteVarint(program.size());
+    for (const StmtUniquePtr &statement : program)
+    {
+        WriteStmt(statement.get());
+    }
+    return Finish();
+}
+
+std::string AstSerializer::Finish()
+{
+    std::string body = std::move(body_);
+    body_.clear();
+    WriteVarint(strings_.size());
+    for (const std::string *str : strings_)
+    {
+        WriteVarint(str->size());
+        body_ += *str;
+    }
+    std::string result = std::move(body_) + body;
+    body_.clear();
+    string_ids_.clear();
+    strings_.clear();
+    return result;
+}
+
+Object AstSerializer::Visit(Binary *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kBinary));
+    WriteExpr(expr->left());
+    WriteToken(expr->oper());
+    WriteExpr(expr->right());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Grouping *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kGrouping));
+    WriteExpr(expr->expression());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Literal *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kLiteral));
+    WriteObject(expr->value());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Unary *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kUnary));
+    WriteToken(expr->oper());
+    WriteExpr(expr->right());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Variable *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kVariable));
+    WriteToken(expr->name());
+    WriteSlot(expr->slot());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Assign *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kAssign));
+    WriteToken(expr->name());
+    WriteSlot(expr->slot());
+    WriteExpr(expr->value());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Logical *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kLogical));
+    WriteExpr(expr->left());
+    WriteToken(expr->oper());
+    WriteExpr(expr->right());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Call *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kCall));
+    WriteExpr(expr->callee());
+    WriteToken(expr->paren());
+    WriteVarint(expr->arguments().size());
+    for (const ExprUniquePtr &argument : expr->arguments())
+    {
+        WriteExpr(argument.get());
+    }
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Get *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kGet));
+    WriteExpr(expr->object());
+    WriteToken(expr->name());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Set *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kSet));
+    WriteExpr(expr->object());
+    WriteToken(expr->name());
+    WriteExpr(expr->value());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(This *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kThis));
+    WriteToken(expr->keyword());
+    WriteSlot(expr->slot());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Super *expr)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kSuper));
+    WriteToken(expr->keyword());
+    WriteToken(expr->method());
+    WriteSlot(expr->slot());
+    WriteSlot(expr->this_slot());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Expression *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kExpression));
+    WriteExpr(stmt->expression());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Print *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kPrint));
+    WriteExpr(stmt->expression());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Var *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kVar));
+    WriteToken(stmt->name());
+    WriteSlot(stmt->slot());
+    WriteExpr(stmt->initializer());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Block *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kBlock));
+    WriteVarint(stmt->statements().size());
+    for (const StmtUniquePtr &statement : stmt->statements())
+    {
+        WriteStmt(statement.get());
+    }
+    return nullptr;
+}
+
+Object AstSerializer::Visit(If *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kIf));
+    WriteExpr(stmt->condition());
+    WriteStmt(stmt->then_branch());
+    WriteStmt(stmt->else_branch());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(While *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kWhile));
+    WriteExpr(stmt->condition());
+    WriteStmt(stmt->body());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Function *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kFunction));
+    WriteFunction(stmt);
+    return nullptr;
+}
+
+void AstSerializer::WriteFunction(Function *stmt)
+{
+    WriteToken(stmt->name());
+    WriteSlot(stmt->slot());
+    WriteSlot(stmt->this_slot());
+    WriteVarint(stmt->params().size());
+    for (size_t i = 0; i < stmt->params().size(); i++)
+    {
+        WriteToken(stmt->params()[i]);
+        WriteSlot(stmt->param_slots()[i]);
+    }
+    WriteVarint(stmt->upvalues().size());
+    for (const UpvalueSource &upvalue : stmt->upvalues())
+    {
+        WriteByte(upvalue.from_cell ? 1 : 0);
+        WriteVarint(upvalue.index);
+    }
+    WriteStmt(stmt->body());
+}
+
+Object AstSerializer::Visit(Return *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kReturn));
+    WriteToken(stmt->keyword());
+    WriteExpr(stmt->value());
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Class *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kClass));
+    WriteToken(stmt->name());
+    WriteSlot(stmt->slot());
+    WriteSlot(stmt->super_slot());
+    WriteExpr(stmt->superclass());
+    WriteVarint(stmt->methods().size());
+    for (const FunctionUniquePtr &method : stmt->methods())
+    {
+        WriteFunction(method.get());
+    }
+    return nullptr;
+}
+
+Object AstSerializer::Visit(Import *stmt)
+{
+    WriteByte(static_cast<uint8_t>(NodeTag::kImport));
+    WriteToken(stmt->keyword());
+    WriteToken(stmt->path_token());
+    return nullptr;
+}
+
+void AstSerializer::WriteExpr(Expr *expr)
+{
+    if (expr == nullptr)
+    {
+        WriteByte(static_cast<uint8_t>(NodeTag::kNull));
+        return;
+    }
+    expr->Accept(this);
+}
+
+void AstSerializer::WriteStmt(Stmt *stmt)
+{
+    if (stmt == nullptr)
+    {
+        WriteByte(static_cast<uint8_t>(NodeTag::kNull));
+        return;
+    }
+    stmt->Accept(this);
+}
+
+void AstSerializer::WriteToken(const Token &token)
+{
+    WriteByte(static_cast<uint8_t>(token.type()));
+    WriteString(token.lexeme());
+    WriteObject(token.literal());
+    WriteVarint(token.line());
+}
+
+void AstSerializer::WriteSlot(const VariableSlot &slot)
+{
+    WriteByte(static_cast<uint8_t>(slot.kind));
+    WriteVarint(slot.index);
+}
+
+void AstSerializer::WriteObject(const Object &value)
+{
+    if (IsObjectInstance<double>(value))
+    {
+        double number = std::get<double>(value);
+        char bytes[sizeof(number)];
+        std::memcpy(bytes, &number, sizeof(number));
+        WriteByte(static_cast<uint8_t>(ValueTag::kNumber));
+        body_.append(bytes, sizeof(bytes));
+    }
+    else if (IsObjectInstance<bool>(value))
+    {
+        WriteByte(static_cast<uint8_t>(std::get<bool>(value) ? ValueTag::kTrue : ValueTag::kFalse));
+    }
+    else if (IsObjectInstance<std::string>(value))
+    {
+        WriteByte(static_cast<uint8_t>(ValueTag::kString));
+        WriteString(std::get<std::string>(value));
+    }
+    else
+    {
+        // the parser only puts nil, numbers, booleans and strings in the tree
+        WriteByte(static_cast<uint8_t>(ValueTag::kNil));
+    }
+}
+
+void AstSerializer::WriteString(const std::string &str)
+{
+    auto [it, inserted] = string_ids_.emplace(str, strings_.size());
+    if (inserted)
+    {
+        strings_.push_back(&it->first);
+    }
+    WriteVarint(it->second);
+}
+
+void AstSerializer::WriteVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        WriteByte(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    WriteByte(static_cast<uint8_t>(value));
+}
+
+void AstSerializer::WriteByte(uint8_t byte)
+{
+    body_.push_back(static_cast<char>(byte));
+}
+
+AstDeserializer::AstDeserializer(std::string_view data) : data_(data)
+{
+    uint64_t count = ReadCount();
+    strings_.reserve(count);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        strings_.emplace_back(ReadBytes(ReadVarint()));
+    }
+}
+
+uint8_t AstDeserializer::ReadByte()
+{
+    if (position_ >= data_.size())
+    {
+        throw SerializationError();
+    }
+    return static_cast<uint8_t>(data_[position_++]);
+}
+
+uint64_t AstDeserializer::ReadVarint()
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = ReadByte();
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw SerializationError();
+}
+
+uint64_t AstDeserializer::ReadCount()
+{
+    uint64_t count = ReadVarint();
+    if (count > data_.size() - position_)
+    {
+        throw SerializationError();
+    }
+    return count;
+}
+
+std::string_view AstDeserializer::ReadBytes(uint64_t size)
+{
+    if (size > data_.size() - position_)
+    {
+        throw SerializationError();
+    }
+    std::string_view bytes = data_.substr(position_, size);
+    position_ += size;
+    return bytes;
+}
+
+const std::string &AstDeserializer::ReadString()
+{
+    uint64_t id = ReadVarint();
+    if (id >= strings_.size())
+    {
+        throw SerializationError();
+    }
+    return strings_[id];
+}
+
+Object AstDeserializer::ReadObject()
+{
+    switch (static_cast<ValueTag>(ReadByte()))
+    {
+    case ValueTag::kNil:
+        return nullptr;
+    case ValueTag::kNumber:
+    {
+        double number;
+        std::memcpy(&number, ReadBytes(sizeof(number)).data(), sizeof(number));
+        return number;
+    }
+    case ValueTag::kFalse:
+        return false;
+    case ValueTag::kTrue:
+        return true;
+    case ValueTag::kString:
+        return ReadString();
+    }
+    throw SerializationError();
+}
+
+Token AstDeserializer::ReadToken()
+{
+    uint8_t type = ReadByte();
+    if (type > static_cast<uint8_t>(Token::Type::kEOF))
+    {
+        throw SerializationError();
+    }
+    const std::string &lexeme = ReadString();
+    Object literal = ReadObject();
+    size_t line = ReadVarint();
+    return Token(static_cast<Token::Type>(type), lexeme, literal, line);
+}
+
+VariableSlot AstDeserializer::ReadSlot()
+{
+    uint8_t kind = ReadByte();
+    if (kind > static_cast<uint8_t>(VariableSlot::Kind::kUpvalue))
+    {
+        throw SerializationError();
+    }
+    uint64_t index = ReadVarint();
+    if (index > UINT32_MAX)
+    {
+        throw SerializationError();
+    }
+    return VariableSlot{static_cast<VariableSlot::Kind>(kind), static_cast<uint32_t>(index)};
+}
+
+ExprUniquePtr AstDeserializer::ReadExpr()
+{
+    switch (static_cast<NodeTag>(ReadByte()))
+    {
+    case NodeTag::kNull:
+        return nullptr;
+    case NodeTag::kBinary:
+    {
+        ExprUniquePtr left = ReadExpr();
+        Token oper = ReadToken();
+        return std::make_unique<Binary>(std::move(left), oper, ReadExpr());
+    }
+    case NodeTag::kGrouping:
+        return std::make_unique<Grouping>(ReadExpr());
+    case NodeTag::kLiteral:
+        return std::make_unique<Literal>(ReadObject());
+    case NodeTag::kUnary:
+    {
+        Token oper = ReadToken();
+        return std::make_unique<Unary>(oper, ReadExpr());
+    }
+    case NodeTag::kVariable:
+    {
+        auto variable = std::make_unique<Variable>(ReadToken());
+        variable->slot() = ReadSlot();
+        return variable;
+    }
+    case NodeTag::kAssign:
+    {
+        Token name = ReadToken();
+        VariableSlot slot = ReadSlot();
+        auto assign = std::make_unique<Assign>(name, ReadExpr());
+        assign->slot() = slot;
+        return assign;
+    }
+    case NodeTag::kLogical:
+    {
+        ExprUniquePtr left = ReadExpr();
+        Token oper = ReadToken();
+        return std::make_unique<Logical>(std::move(left), oper, ReadExpr());
+    }
+    case NodeTag::kCall:
+    {
+        ExprUniquePtr callee = ReadExpr();
+        Token paren = ReadToken();
+        ExprList arguments(ReadCount());
+        for (ExprUniquePtr &argument : arguments)
+        {
+            argument = ReadExpr();
+        }
+        return std::make_unique<Call>(std::move(callee), paren, std::move(arguments));
+    }
+    case NodeTag::kGet:
+    {
+        ExprUniquePtr object = ReadExpr();
+        return std::make_unique<Get>(std::move(object), ReadToken());
+    }
+    case NodeTag::kSet:
+    {
+        ExprUniquePtr object = ReadExpr();
+        Token name = ReadToken();
+        return std::make_unique<Set>(std::move(object), name, ReadExpr());
+    }
+    case NodeTag::kThis:
+    {
+        auto expr = std::make_unique<This>(ReadToken());
+        expr->slot() = ReadSlot();
+        return expr;
+    }
+    case NodeTag::kSuper:
+    {
+        Token keyword = ReadToken();
+        auto expr = std::make_unique<Super>(keyword, ReadToken());
+        expr->slot() = ReadSlot();
+        expr->this_slot() = ReadSlot();
+        return expr;
+    }
+    default:
+        throw SerializationError();
+    }
+}
+
+StmtUniquePtr AstDeserializer::ReadStmt()
+{
+    switch (static_cast<NodeTag>(ReadByte()))
+    {
+    case NodeTag::kNull:
+        return nullptr;
+    case NodeTag::kExpression:
+        return std::make_unique<Expression>(ReadExpr());
+    case NodeTag::kPrint:
+        return std::make_unique<Print>(ReadExpr());
+    case NodeTag::kVar:
+    {
+        Token name = ReadToken();
+        VariableSlot slot = ReadSlot();
+        auto var = std::make_unique<Var>(name, ReadExpr());
+        var->slot() = slot;
+        return var;
+    }
+    case NodeTag::kBlock:
+    {
+        StmtList statements(ReadCount());
+        for (StmtUniquePtr &statement : statements)
+        {
+            statement = ReadStmt();
+        }
+        return std::make_unique<Block>(std::move(statements));
+    }
+    case NodeTag::kIf:
+    {
+        ExprUniquePtr condition = ReadExpr();
+        StmtUniquePtr then_branch = ReadStmt();
+        return std::make_unique<If>(std::move(condition), std::move(then_branch), ReadStmt());
+    }
+    case NodeTag::kWhile:
+    {
+        ExprUniquePtr condition = ReadExpr();
+        return std::make_unique<While>(std::move(condition), ReadStmt());
+    }
+    case NodeTag::kFunction:
+        return ReadFunction();
+    case NodeTag::kReturn:
+    {
+        Token keyword = ReadToken();
+        return std::make_unique<Return>(keyword, ReadExpr());
+    }
+    case NodeTag::kClass:
+    {
+        Token name = ReadToken();
+        VariableSlot slot = ReadSlot();
+        VariableSlot super_slot = ReadSlot();
+        std::unique_ptr<Variable> superclass;
+        if (ExprUniquePtr expr = ReadExpr())
+        {
+            if (dynamic_cast<Variable *>(expr.get()) == nullptr)
+            {
+                throw SerializationError();
+            }
+            superclass.reset(static_cast<Variable *>(expr.release()));
+        }
+        std::vector<FunctionUniquePtr> methods(ReadCount());
+        for (FunctionUniquePtr &method : methods)
+        {
+            method = ReadFunction();
+        }
+        auto klass = std::make_unique<Class>(name, std::move(superclass), std::move(methods));
+        klass->slot() = slot;
+        klass->super_slot() = super_slot;
+        return klass;
+    }
+    case NodeTag::kImport:
+    {
+        Token keyword = ReadToken();
+        Token path = ReadToken();
+        if (!IsObjectInstance<std::string>(path.literal()))
+        {
+            throw SerializationError();
+        }
+        return std::make_unique<Import>(keyword, path);
+    }
+    default:
+        throw SerializationError();
+    }
+}
+
+FunctionUniquePtr AstDeserializer::ReadFunction()
+{
+    Token name = ReadToken();
+    VariableSlot slot = ReadSlot();
+    VariableSlot this_slot = ReadSlot();
+    std::vector<Token> params;
+    std::vector<VariableSlot> param_slots;
+    uint64_t count = ReadCount();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        params.push_back(ReadToken());
+        param_slots.push_back(ReadSlot());
+    }
+    std::vector<UpvalueSource> upvalues(ReadCount());
+    for (UpvalueSource &upvalue : upvalues)
+    {
+        upvalue.from_cell = ReadByte() != 0;
+        upvalue.index = static_cast<uint32_t>(ReadVarint());
+    }
+    auto function = std::make_unique<Function>(name, params, ReadStmt());
+    function->slot() = slot;
+    function->this_slot() = this_slot;
+    function->param_slots() = std::move(param_slots);
+    function->upvalues() = std::move(upvalues);
+    return function;
+}
+
+bool DeserializeProgram(std::string_view data, Program *program)
+{
+    try
+    {
+        AstDeserializer reader(data);
+        Program result(reader.ReadCount());
+        for (StmtUniquePtr &statement : result)
+        {
+            statement = reader.ReadStmt();
+        }
+        if (!reader.AtEnd())
+        {
+            return false;
+        }
+        *program = std::move(result);
+        return true;
+    }
+    catch (const SerializationError &)
+    {
+        return false;
+    }
+}
+} // namespace lox
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+
+namespace lox
+{
+// Bumped whenever the AST or its encoding changes; part of every cache and
+// snapshot key so stale files are never decoded.
+constexpr uint32_t kAstFormatVersion = 7;
+
+class SerializationError : public std::runtime_error
+{
+  public:
+    SerializationError() : std::runtime_error("malformed serialized data") {}
+};
+
+// Compact binary form of a parsed program, used by the compile cache and
+// snapshots.
+//
+// Layout: the string table (count, then length-prefixed strings) followed by
+// the body. Every node starts with a one-byte tag, integers are LEB128 varints
+// and tokens refer to their lexeme through the table, so an identifier used a
+// thousand times is stored once. The Resolver's slots and upvalue lists are
+// stored too, so a loaded tree is ready to run. Serialize() writes a whole
+// program; other formats write their own body with the Write* calls and then
+// Finish().
+class AstSerializer : public expr::ExprVisitor, public stmt::StmtVisitor
+{
+  public:
+    std::string Serialize(const Program &program);
+    std::string Finish();
+
+    void WriteExpr(expr::Expr *expr);
+    void WriteStmt(stmt::Stmt *stmt);
+    void WriteFunction(stmt::Function *function);
+    void WriteToken(const Token &token);
+    void WriteSlot(const VariableSlot &slot);
+    void WriteObject(const Object &value);
+    void WriteString(const std::string &str);
+    void WriteVarint(uint64_t value);
+    void WriteByte(uint8_t byte);
+
+    Object Visit(expr::Binary *expr) override;
+    Object Visit(expr::Grouping *expr) override;
+    Object Visit(expr::Literal *expr) override;
+    Object Visit(expr::Unary *expr) override;
+    Object Visit(expr::Variable *expr) override;
+    Object Visit(expr::Assign *expr) override;
+    Object Visit(expr::Logical *expr) override;
+    Object Visit(expr::Call *expr) override;
+    Object Visit(expr::Get *expr) override;
+    Object Visit(expr::Set *expr) override;
+    Object Visit(expr::This *expr) override;
+    Object Visit(expr::Super *expr) override;
+
+    Object Visit(stmt::Expression *stmt) override;
+    Object Visit(stmt::Print *stmt) override;
+    Object Visit(stmt::Var *stmt) override;
+    Object Visit(stmt::Block *stmt) override;
+    Object Visit(stmt::If *stmt) override;
+    Object Visit(stmt::While *stmt) override;
+    Object Visit(stmt::Function *stmt) override;
+    Object Visit(stmt::Return *stmt) override;
+    Object Visit(stmt::Class *stmt) override;
+    Object Visit(stmt::Import *stmt) override;
+
+  private:
+    std::string body_;
+    std::unordered_map<std::string, uint64_t> string_ids_;
+    std::vector<const std::string *> strings_;
+};
+
+// Reads what an AstSerializer wrote, in the same order. Every call throws
+// SerializationError on truncated or malformed data.
+class AstDeserializer
+{
+  public:
+    // reads the string table
+    explicit AstDeserializer(std::string_view data);
+
+    bool AtEnd() const
+    {
+        return position_ == data_.size();
+    }
+
+    uint8_t ReadByte();
+    uint64_t ReadVarint();
+    // an element count, bounded by the bytes left since every element takes one
+    uint64_t ReadCount();
+    const std::string &ReadString();
+    Object ReadObject();
+    Token ReadToken();
+    VariableSlot ReadSlot();
+    ExprUniquePtr ReadExpr();
+    StmtUniquePtr ReadStmt();
+    FunctionUniquePtr ReadFunction();
+
+  private:
+    std::string_view ReadBytes(uint64_t size);
+
+  private:
+    std::string_view data_;
+    size_t position_ = 0;
+    std::vector<std::string> strings_;
+};
+
+// Rebuilds a program written by AstSerializer::Serialize. Returns false
+// (leaving `program` unspecified) when the data is truncated or malformed.
+bool DeserializeProgram(std::string_view data, Program *program);
+} // namespace lox
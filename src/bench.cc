@@ -0,0 +1,153 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "callable.h"
+#include "error.h"
+#include "interpreter.h"
+
+namespace lox
+{
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr double kWarmupSeconds = 0.05;
+constexpr double kTargetSampleSeconds = 0.01;
+constexpr size_t kSampleCount = 30;
+// samples further than this many (scaled) MADs above the median are dropped
+constexpr double kOutlierThreshold = 3.0;
+// calls per sample; well past anything that finishes, and exact as a double
+constexpr double kMaxIterations = 1e12;
+
+double SecondsSince(Clock::time_point begin)
+{
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+// run one batch of calls and return the time per call in seconds
+double RunBatch(Interpreter *interpreter, Callable *function, size_t batch)
+{
+    static const std::vector<Object> kNoArguments;
+    auto begin = Clock::now();
+    for (size_t i = 0; i < batch; i++)
+    {
+        function->Call(interpreter, kNoArguments);
+    }
+    return SecondsSince(begin) / static_cast<double>(batch);
+}
+
+double Percentile(const std::vector<double> &sorted, double percent)
+{
+    // nearest-rank percentile
+    size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted.at(std::clamp<size_t>(rank, 1, sorted.size()) - 1);
+}
+
+std::string FormatDuration(double seconds)
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3);
+    if (seconds < 1e-6)
+    {
+        oss << seconds * 1e9 << " ns";
+    }
+    else if (seconds < 1e-3)
+    {
+        oss << seconds * 1e6 << " us";
+    }
+    else if (seconds < 1.0)
+    {
+        oss << seconds * 1e3 << " ms";
+    }
+    else
+    {
+        oss << seconds << " s";
+    }
+    return oss.str();
+}
+} // namespace
+
+Object BenchFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    if (!IsObjectInstance<CallablePtr>(arguments.at(0)) || std::get<CallablePtr>(arguments.at(0))->arity() != 0)
+    {
+        throw NativeError("bench() expects a function taking no arguments.");
+    }
+    if (!IsObjectInstance<double>(arguments.at(1)))
+    {
+        throw NativeError("bench() expects the iteration count to be a number.");
+    }
+    double requested = std::get<double>(arguments.at(1));
+    if (!std::isfinite(requested) || requested > kMaxIterations)
+    {
+        throw NativeError("bench() expects a finite iteration count of at most 1e12.");
+    }
+
+    CallablePtr function = std::get<CallablePtr>(arguments.at(0));
+
+    // warmup, which doubles as a first estimate of the cost of one call
+    size_t warmup_calls = 0;
+    auto warmup_begin = Clock::now();
+    do
+    {
+        RunBatch(interpreter, function, 1);
+        warmup_calls++;
+    } while (SecondsSince(warmup_begin) < kWarmupSeconds);
+    double estimate = SecondsSince(warmup_begin) / static_cast<double>(warmup_calls);
+
+    size_t batch = 1;
+    if (requested >= 1.0)
+    {
+        batch = static_cast<size_t>(requested);
+    }
+    else if (estimate > 0.0)
+    {
+        batch = std::max<size_t>(1, static_cast<size_t>(kTargetSampleSeconds / estimate));
+    }
+
+    std::vector<double> samples;
+    samples.reserve(kSampleCount);
+    for (size_t i = 0; i < kSampleCount; i++)
+    {
+        samples.push_back(RunBatch(interpreter, function, batch));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double median = Percentile(samples, 50.0);
+    std::vector<double> deviations;
+    deviations.reserve(samples.size());
+    for (double sample : samples)
+    {
+        deviations.push_back(std::abs(sample - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    // 1.4826 scales the MAD to the standard deviation of a normal distribution
+    double limit = median + kOutlierThreshold * 1.4826 * Percentile(deviations, 50.0);
+
+    std::vector<double> kept;
+    kept.reserve(samples.size());
+    for (double sample : samples)
+    {
+        if (sample <= limit)
+        {
+            kept.push_back(sample);
+        }
+    }
+
+    median = Percentile(kept, 50.0);
+    std::ostringstream report;
+    report << "bench " << function->ToString() << ": median " << FormatDuration(median) << ", p95 "
+           << FormatDuration(Percentile(kept, 95.0)) << ", min " << FormatDuration(kept.front()) << " ("
+           << kept.size() << " samples x " << batch << " iterations, " << samples.size() - kept.size()
+           << " outliers rejected)";
+    interpreter->output().Write(report.str());
+    interpreter->output().EndLine();
+
+    return median;
+}
+} // namespace lox
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+#include "object.h"
+
+namespace lox
+{
+class Interpreter;
+
+// bench(fn, iterations): native micro-benchmark harness.
+//
+// Calls the zero-argument function `fn` repeatedly: first a warmup phase, then a
+// fixed number of timed samples of `iterations` calls each (when `iterations` is
+// below 1 the batch size is scaled so that one sample takes roughly 10ms; a
+// count that is not finite or above 1e12 is an error).
+// Slow outliers are rejected with a median-absolute-deviation filter, the
+// median / p95 / min time per call is printed and the median (in seconds) is
+// returned.
+Object BenchFunc(Interpreter *interpreter, const std::vector<Object> &arguments);
+} // namespace lox
@@ -2,6 +2,8 @@
 #include "ast.h"
 #include "environment.h"
 #include "control_exception.h"
+#include "profiler.h"
+#include "trace.h"
 
 #include <cstddef>
 #include <memory>
@@ -16,6 +18,7 @@ BuiltinCallable::BuiltinCallable(const std::string &func_name, CallFunc func, in
 
 Object BuiltinCallable::Call(Interpreter *interpreter, const std::vector<Object> &arguments)
 {
+    TraceScope trace_scope("native", func_name_, Trace::calls_enabled());
     return func_(interpreter, arguments);
 }
 
@@ -29,15 +32,29 @@ std::string BuiltinCallable::ToString()
     return "<native func " + func_name_ + ">";
 }
 
-UserDefineCallable::UserDefineCallable(stmt::Function *declaration) : declaration_(declaration) {}
+UserDefineCallable::UserDefineCallable(stmt::Function *declaration, std::vector<CellPtr> upvalues)
+    : declaration_(declaration), upvalues_(std::move(upvalues))
+{
+}
 
 Object UserDefineCallable::Call(Interpreter *interpreter, const std::vector<Object> &arguments)
 {
-    auto environment = std::make_unique<Environment>(interpreter->globals());
+    return Invoke(interpreter, nullptr, arguments);
+}
+
+Object UserDefineCallable::Invoke(Interpreter *interpreter, Instance *receiver, const std::vector<Object> &arguments)
+{
+    ProfilerFrame profiler_frame(&declaration_->name());
+    TraceScope trace_scope("call", declaration_->name().lexeme(), Trace::calls_enabled());
+    CallFrame frame(interpreter, &upvalues_);
 
-    for (int i = 0; i < declaration_->params().size(); i++)
+    if (receiver != nullptr)
     {
-        environment->Define(declaration_->params().at(i).lexeme(), arguments.at(i));
+        interpreter->DefineVariable(declaration_->this_slot(), declaration_->name(), receiver);
+    }
+    for (size_t i = 0; i < declaration_->params().size(); i++)
+    {
+        interpreter->DefineVariable(declaration_->param_slots()[i], declaration_->params()[i], arguments.at(i));
     }
 
     stmt::Block *block = dynamic_cast<stmt::Block *>(declaration_->body());
@@ -46,16 +63,34 @@ Object UserDefineCallable::Call(Interpreter *interpreter, const std::vector<Obje
     {
         return nullptr;
     }
+    Object result = nullptr;
     try 
     {
-        interpreter->ExecuteBlock(block->statements(), environment.get());
+        interpreter->ExecuteBlock(block->statements());
     }
     catch(const control::Return& e)
     {
-        return e.value();
+        result = e.value();
     }
 
-    return nullptr;
+    if (initializer_ && receiver != nullptr)
+    {
+        return receiver;
+    }
+    return result;
+}
+
+void UserDefineCallable::Trace(Heap *heap)
+{
+    for (Cell *cell : upvalues_)
+    {
+        heap->Mark(cell);
+    }
+}
+
+size_t UserDefineCallable::HeapSize() const
+{
+    return sizeof(UserDefineCallable) + upvalues_.capacity() * sizeof(CellPtr);
 }
 
 size_t UserDefineCallable::arity()
@@ -3,13 +3,15 @@
 #include <functional>
 #include <vector>
 
+#include "gc.h"
 #include "interpreter.h"
 #include "object.h"
 #include "ast.h"
 
 namespace lox
 {
-class Callable
+// functions are heap objects, allocated through Interpreter::heap()
+class Callable : public GcObject
 {
   public:
     virtual Object Call(Interpreter *interpreter, const std::vector<Object>& arguments) = 0;
@@ -30,6 +32,16 @@ class BuiltinCallable : public Callable
 
     std::string ToString() override;
 
+    size_t HeapSize() const override
+    {
+        return sizeof(BuiltinCallable);
+    }
+
+    const std::string &name() const
+    {
+        return func_name_;
+    }
+
   private:
     std::string func_name_;
     CallFunc func_;
@@ -39,16 +51,44 @@ class BuiltinCallable : public Callable
 class UserDefineCallable : public Callable
 {
   public:
-    UserDefineCallable(stmt::Function* declaration);
+    UserDefineCallable(stmt::Function* declaration, std::vector<CellPtr> upvalues = {});
 
     Object Call(Interpreter *interpreter, const std::vector<Object>& arguments) override;
 
+    // calls a method with `this` bound to receiver; an initializer always returns it
+    Object Invoke(Interpreter *interpreter, Instance *receiver, const std::vector<Object> &arguments);
+
     size_t arity() override;
 
     std::string ToString() override;
 
+    void Trace(Heap *heap) override;
+    size_t HeapSize() const override;
+
+    stmt::Function *declaration() const
+    {
+        return declaration_;
+    }
+
+    const std::vector<CellPtr> &upvalues() const
+    {
+        return upvalues_;
+    }
+
+    bool initializer() const
+    {
+        return initializer_;
+    }
+
+    void set_initializer(bool initializer)
+    {
+        initializer_ = initializer;
+    }
+
   private:
     stmt::Function* declaration_;
+    std::vector<CellPtr> upvalues_;
+    bool initializer_ = false;
 };
 
 } // namespace lox
\ No newline at end of file
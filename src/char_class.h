@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace lox
+{
+// 256-entry character classification built at compile time, replacing chains
+// of range comparisons in the scanner's scalar paths
+enum CharClass : uint8_t
+{
+    kCharDigit = 1 << 0,
+    kCharAlpha = 1 << 1, // letters and '_'
+    kCharWhitespace = 1 << 2,
+};
+
+constexpr std::array<uint8_t, 256> MakeCharClassTable()
+{
+    std::array<uint8_t, 256> table{};
+    for (int c = '0'; c <= '9'; c++)
+    {
+        table[c] |= kCharDigit;
+    }
+    for (int c = 'a'; c <= 'z'; c++)
+    {
+        table[c] |= kCharAlpha;
+        table[c - 'a' + 'A'] |= kCharAlpha;
+    }
+    table['_'] |= kCharAlpha;
+    table[' '] |= kCharWhitespace;
+    table['\t'] |= kCharWhitespace;
+    table['\r'] |= kCharWhitespace;
+    table['\n'] |= kCharWhitespace;
+    return table;
+}
+
+inline constexpr std::array<uint8_t, 256> kCharClassTable = MakeCharClassTable();
+
+constexpr bool HasCharClass(char c, uint8_t classes)
+{
+    return (kCharClassTable[static_cast<unsigned char>(c)] & classes) != 0;
+}
+} // namespace lox
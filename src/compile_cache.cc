@@ -0,0 +1,115 @@
+#include "compile_cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+#include "ast_serializer.h"
+#include "mapped_file.h"
+#include "stats.h"
+
+namespace lox
+{
+namespace
+{
+constexpr char kMagic[4] = {'L', 'O', 'X', 'C'};
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+};
+
+uint64_t Fnv1a(std::string_view data, uint64_t hash = 14695981039346656037ull)
+{
+    for (char c : data)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t SourceHash(const std::string &source)
+{
+    std::string_view version(reinterpret_cast<const char *>(&kAstFormatVersion), sizeof(kAstFormatVersion));
+    return Fnv1a(source, Fnv1a(version));
+}
+
+} // namespace
+
+std::string CompileCache::directory_;
+
+bool CompileCache::Load(const std::string &source, Program *program)
+{
+    uint64_t hash = SourceHash(source);
+    MappedFile file(PathFor(hash));
+    std::string_view data = file.data();
+
+    CacheHeader header;
+    bool hit = data.size() >= sizeof(header);
+    if (hit)
+    {
+        std::memcpy(&header, data.data(), sizeof(header));
+        data.remove_prefix(sizeof(header));
+        hit = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kAstFormatVersion &&
+              header.source_hash == hash && header.source_size == source.size() &&
+              header.payload_size == data.size() && header.payload_hash == Fnv1a(data) &&
+              DeserializeProgram(data, program);
+    }
+
+    Stats::RecordCacheLookup(hit);
+    return hit;
+}
+
+void CompileCache::Store(const std::string &source, const Program &program)
+{
+    std::string payload = AstSerializer().Serialize(program);
+
+    CacheHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kAstFormatVersion;
+    header.source_hash = SourceHash(source);
+    header.source_size = source.size();
+    header.payload_size = payload.size();
+    header.payload_hash = Fnv1a(payload);
+
+    // the cache is best effort: any failure just leaves the entry missing.
+    // Writing a temporary file and renaming it over the entry means concurrent
+    // runs never see a half-written file.
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    std::string path = PathFor(header.source_hash);
+    std::string temporary = path + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(payload.data(), payload.size());
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+std::string CompileCache::PathFor(uint64_t hash)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.loxc", static_cast<unsigned long long>(hash));
+    return (std::filesystem::path(directory_) / name).string();
+}
+} // namespace lox
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "ast.h"
+
+namespace lox
+{
+// Compile cache behind --cache[=dir].
+//
+// The parsed program of a script is serialized (see AstSerializer) to
+// <dir>/<hash>.loxc, where the hash is FNV-1a over the cache format version
+// and the source text. Later runs of the same source map that file and rebuild
+// the AST from it without running the Scanner or the Parser. A cache file that
+// is short, corrupt or was written for other source counts as a miss. Only
+// programs that parsed without errors are stored.
+class CompileCache
+{
+  public:
+    static void Enable(const std::string &directory)
+    {
+        directory_ = directory;
+    }
+
+    static bool enabled()
+    {
+        return !directory_.empty();
+    }
+
+    static bool Load(const std::string &source, Program *program);
+    static void Store(const std::string &source, const Program &program);
+
+  private:
+    static std::string PathFor(uint64_t hash);
+
+  private:
+    static std::string directory_;
+};
+} // namespace lox
@@ -43,6 +43,17 @@ class Continue : public std::exception
     Token keyword_;
 };
 
+// thrown at the next statement once Interpreter::Interrupt() has been called;
+// only the embedder catches it, after the whole run has unwound
+class Interrupt : public std::exception
+{
+  public:
+    const char *what() const noexcept override
+    {
+        return "interrupted";
+    }
+};
+
 class Break : public std::exception
 {
   public:
@@ -0,0 +1,235 @@
+#include "counting_interpreter.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "line_finder.h"
+
+using namespace lox;
+using namespace lox::expr;
+using namespace lox::stmt;
+
+template <typename Node>
+CountingInterpreter::NodeCounter &CountingInterpreter::Counter(Node *node)
+{
+    auto [it, inserted] = nodes_.try_emplace(node);
+    NodeCounter &counter = it->second;
+    if (inserted)
+    {
+        // nodes without any token (literals, desugared blocks) belong to the line executing them
+        size_t line = LineOf(node);
+        counter.line = line != 0 ? line : current_line_;
+        counter.line_counter = &lines_[counter.line];
+        counter.line_counter->nodes++;
+    }
+    counter.count++;
+    return counter;
+}
+
+template <typename Body>
+Object CountingInterpreter::CountExpr(Expr *node, Body body)
+{
+    NodeCounter &counter = Counter(node);
+    counter.line_counter->exprs++;
+
+    size_t previous_line = current_line_;
+    current_line_ = counter.line;
+    Object result = body();
+    current_line_ = previous_line;
+    return result;
+}
+
+template <typename Body>
+Object CountingInterpreter::CountStmt(Stmt *node, Body body)
+{
+    NodeCounter &counter = Counter(node);
+    LineCounter &line_counter = *counter.line_counter;
+    line_counter.stmts++;
+
+    size_t previous_line = current_line_;
+    current_line_ = counter.line;
+    line_counter.active++;
+    stmt_depth_++;
+    auto begin = Clock::now();
+
+    auto finish = [&]() {
+        auto elapsed = Clock::now() - begin;
+        // only the outermost activation of a line adds time, so recursion is not counted twice
+        if (--line_counter.active == 0)
+        {
+            line_counter.time += elapsed;
+        }
+        if (--stmt_depth_ == 0)
+        {
+            total_time_ += elapsed;
+        }
+        current_line_ = previous_line;
+    };
+
+    try
+    {
+        Object result = body();
+        finish();
+        return result;
+    }
+    catch (...)
+    {
+        finish();
+        throw;
+    }
+}
+
+Object CountingInterpreter::Visit(Binary *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Grouping *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Literal *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Unary *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Variable *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Assign *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Logical *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Call *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Get *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Set *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(This *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Super *expr)
+{
+    return CountExpr(expr, [&]() { return Interpreter::Visit(expr); });
+}
+
+Object CountingInterpreter::Visit(Expression *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Print *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Var *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Block *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(If *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(While *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Function *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Return *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Class *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+Object CountingInterpreter::Visit(Import *stmt)
+{
+    return CountStmt(stmt, [&]() { return Interpreter::Visit(stmt); });
+}
+
+void CountingInterpreter::Discard(StmtUniquePtr statement)
+{
+    discarded_.push_back(std::move(statement));
+}
+
+void CountingInterpreter::Report(size_t top_n)
+{
+    std::vector<std::pair<size_t, const LineCounter *>> lines;
+    for (const auto &[line, counter] : lines_)
+    {
+        lines.emplace_back(line, &counter);
+    }
+    std::sort(lines.begin(), lines.end(), [](const auto &a, const auto &b) {
+        if (a.second->time != b.second->time)
+        {
+            return a.second->time > b.second->time;
+        }
+        return a.second->stmts + a.second->exprs > b.second->stmts + b.second->exprs;
+    });
+    if (lines.size() > top_n)
+    {
+        lines.resize(top_n);
+    }
+
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    double total = Milliseconds(total_time_).count();
+
+    std::cerr << "hot lines (top " << lines.size() << " by inclusive time, total " << std::fixed
+              << std::setprecision(3) << total << " ms):\n";
+    std::cerr << std::setw(8) << "line" << std::setw(14) << "stmts" << std::setw(14) << "exprs" << std::setw(8)
+              << "nodes" << std::setw(14) << "time(ms)" << std::setw(9) << "%" << "\n";
+    for (const auto &[line, counter] : lines)
+    {
+        double time = Milliseconds(counter->time).count();
+        std::cerr << std::setw(8) << line << std::setw(14) << counter->stmts << std::setw(14) << counter->exprs
+                  << std::setw(8) << counter->nodes << std::setw(14) << time << std::setw(8)
+                  << std::setprecision(1) << (total > 0.0 ? 100.0 * time / total : 0.0) << "%"
+                  << std::setprecision(3) << "\n";
+    }
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << std::flush;
+}
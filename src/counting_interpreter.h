@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include "interpreter.h"
+
+namespace lox
+{
+// Interpreter used for --count: every statement and expression visit bumps a
+// per-node counter keyed by its source line, and statements accumulate
+// inclusive time per line (recursive activations of a line are timed once).
+// Selected at startup, so the plain Interpreter pays nothing for it.
+class CountingInterpreter : public Interpreter
+{
+  public:
+    Object Visit(expr::Binary *expr) override;
+    Object Visit(expr::Grouping *expr) override;
+    Object Visit(expr::Literal *expr) override;
+    Object Visit(expr::Unary *expr) override;
+    Object Visit(expr::Variable *expr) override;
+    Object Visit(expr::Assign *expr) override;
+    Object Visit(expr::Logical *expr) override;
+    Object Visit(expr::Call *expr) override;
+    Object Visit(expr::Get *expr) override;
+    Object Visit(expr::Set *expr) override;
+    Object Visit(expr::This *expr) override;
+    Object Visit(expr::Super *expr) override;
+
+    Object Visit(stmt::Expression *stmt) override;
+    Object Visit(stmt::Print *stmt) override;
+    Object Visit(stmt::Var *stmt) override;
+    Object Visit(stmt::Block *stmt) override;
+    Object Visit(stmt::If *stmt) override;
+    Object Visit(stmt::While *stmt) override;
+    Object Visit(stmt::Function *stmt) override;
+    Object Visit(stmt::Return *stmt) override;
+    Object Visit(stmt::Class *stmt) override;
+    Object Visit(stmt::Import *stmt) override;
+
+    // the counters are keyed by node, so a freed statement's address could be
+    // reused by a node on another line; statements are kept until the report
+    void Discard(StmtUniquePtr statement) override;
+
+    void Report(size_t top_n);
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct LineCounter
+    {
+        uint64_t stmts = 0;
+        uint64_t exprs = 0;
+        size_t nodes = 0;
+        Clock::duration time{};
+        int active = 0;
+    };
+
+    struct NodeCounter
+    {
+        size_t line = 0;
+        uint64_t count = 0;
+        LineCounter *line_counter = nullptr;
+    };
+
+    template <typename Body>
+    Object CountExpr(expr::Expr *node, Body body);
+    template <typename Body>
+    Object CountStmt(stmt::Stmt *node, Body body);
+
+    template <typename Node>
+    NodeCounter &Counter(Node *node);
+
+  private:
+    std::unordered_map<const void *, NodeCounter> nodes_;
+    std::unordered_map<size_t, LineCounter> lines_;
+    size_t current_line_ = 0;
+    size_t stmt_depth_ = 0;
+    Clock::duration total_time_{};
+    Program discarded_;
+};
+} // namespace lox
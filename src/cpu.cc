@@ -0,0 +1,53 @@
+#include "cpu.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(LOX_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace lox
+{
+namespace
+{
+CpuFeatures Detect()
+{
+    CpuFeatures features;
+#if defined(LOX_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    if (max_leaf >= 7 && os_saves_ymm)
+    {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+
+    const char *limit = std::getenv("LOX_SIMD");
+    if (limit != nullptr && std::strcmp(limit, "avx2") != 0)
+    {
+        features.avx2 = false;
+        features.sse2 = features.sse2 && std::strcmp(limit, "sse2") == 0;
+    }
+    return features;
+}
+} // namespace
+
+const CpuFeatures &GetCpuFeatures()
+{
+    static const CpuFeatures features = Detect();
+    return features;
+}
+} // namespace lox
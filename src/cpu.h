@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LOX_X86 1
+#endif
+
+// functions using AVX2 intrinsics are compiled for AVX2 individually and only
+// called after GetCpuFeatures() reported support
+#if defined(LOX_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LOX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LOX_TARGET_AVX2
+#endif
+
+namespace lox
+{
+struct CpuFeatures
+{
+    bool sse2 = false;
+    bool avx2 = false;
+};
+
+// detected once; the LOX_SIMD environment variable (scalar, sse2 or avx2) caps
+// what is reported, which is how the fallbacks are exercised on any machine
+const CpuFeatures &GetCpuFeatures();
+
+inline unsigned CountTrailingZeros(uint32_t value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+inline unsigned PopCount(uint32_t value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    return (((value + (value >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#else
+    return __builtin_popcount(value);
+#endif
+}
+} // namespace lox
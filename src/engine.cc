@@ -0,0 +1,88 @@
+#include "engine.h"
+
+#include "control_exception.h"
+#include "interpreter.h"
+#include "lox.h"
+#include "modules.h"
+
+namespace lox
+{
+Script Script::Compile(const std::string &source, std::ostream &errors)
+{
+    // nothing has been printed that the errors could overtake
+    ErrorState state(&errors, nullptr);
+    ErrorStateScope error_scope(&state);
+    auto program = std::make_shared<Program>(Lox::Compile(source));
+
+    Script script;
+    if (!state.had_error)
+    {
+        script.program_ = std::move(program);
+    }
+    return script;
+}
+
+Engine::Engine(Output *output, std::ostream &errors)
+    : interpreter_(std::make_unique<Interpreter>()), errors_(&errors, output)
+{
+    interpreter_->set_output(output);
+}
+
+Engine::~Engine() = default;
+
+void Engine::set_output(Output *output, std::ostream &errors)
+{
+    interpreter_->set_output(output);
+    errors_.output = output;
+    errors_.stream = &errors;
+}
+
+bool Engine::Execute(const Script &script, const Bindings &bindings)
+{
+    if (!script.valid())
+    {
+        return false;
+    }
+
+    ErrorStateScope error_scope(&errors_);
+    errors_.had_error = false;
+    errors_.had_runtime_error = false;
+    for (const auto &[name, value] : bindings)
+    {
+        interpreter_->globals()->Define(name, value);
+    }
+    programs_.insert(script.program_);
+    Modules::Prefetch(*script.program_, interpreter_->module_directory());
+    try
+    {
+        interpreter_->Interpret(*script.program_);
+    }
+    catch (const control::Interrupt &)
+    {
+        if (errors_.output != nullptr)
+        {
+            errors_.output->Sync();
+        }
+        *errors_.stream << "Execution interrupted." << std::endl;
+        errors_.had_runtime_error = true;
+    }
+    return !errors_.had_error && !errors_.had_runtime_error;
+}
+
+void Engine::Interrupt()
+{
+    interpreter_->Interrupt();
+}
+
+bool Engine::interrupted() const
+{
+    return interpreter_->interrupted();
+}
+
+const Object *Engine::Global(const std::string &name) const
+{
+    const auto &values = interpreter_->globals()->values();
+    auto it = values.find(name);
+    return it != values.end() ? &it->second : nullptr;
+}
+} // namespace lox
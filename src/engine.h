@@ -0,0 +1,89 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+#include "object.h"
+#include "output.h"
+
+namespace lox
+{
+class Interpreter;
+
+// Source compiled once: scanned, parsed and resolved, ready to be executed
+// any number of times by any number of Engines. The compiled program is
+// immutable, so copies share it and engines on different threads may run it
+// at the same time; everything a run changes lives in the engine.
+class Script
+{
+  public:
+    // syntax and resolution errors are written to `errors` and leave the
+    // script invalid
+    static Script Compile(const std::string &source, std::ostream &errors = std::cerr);
+
+    bool valid() const
+    {
+        return program_ != nullptr;
+    }
+
+  private:
+    friend class Engine;
+
+    std::shared_ptr<const Program> program_;
+};
+
+// The embedding API: an interpreter that runs compiled Scripts without
+// scanning or parsing them again. Globals persist from one Execute() to the
+// next, so a prelude can define the functions later scripts call. An engine
+// is the execution context of one thread at a time: its globals, call
+// frames, heap, inline caches and output.
+class Engine
+{
+  public:
+    using Bindings = std::vector<std::pair<std::string, Object>>;
+
+    explicit Engine(Output *output = &Output::Standard(), std::ostream &errors = std::cerr);
+    ~Engine();
+
+    Engine(const Engine &) = delete;
+    Engine &operator=(const Engine &) = delete;
+
+    // defines each binding as a global, then runs the script; false if the
+    // script is invalid, stopped at an error or was interrupted. Heap values
+    // among the bindings must come from this engine.
+    bool Execute(const Script &script, const Bindings &bindings = {});
+
+    // stops the running script at its next statement and every later one;
+    // safe to call from any thread
+    void Interrupt();
+    bool interrupted() const;
+
+    const ErrorState &errors() const
+    {
+        return errors_;
+    }
+
+    // where later runs print and report errors
+    void set_output(Output *output, std::ostream &errors);
+
+    // a global such as a result the script stored, or nullptr
+    const Object *Global(const std::string &name) const;
+
+    Interpreter *interpreter()
+    {
+        return interpreter_.get();
+    }
+
+  private:
+    // kept for the functions that point into them; outlive the interpreter
+    std::unordered_set<std::shared_ptr<const Program>> programs_;
+    std::unique_ptr<Interpreter> interpreter_;
+    ErrorState errors_;
+};
+} // namespace lox
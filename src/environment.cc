@@ -11,11 +11,11 @@ void Environment::Define(const std::string &name, const Object &value)
 const Object &Environment::Get(const Token &name) 
 {
     auto it = values_.find(name.lexeme());
-    if(it != values_.end())
+    if (it != values_.end())
     {
+        Stats::RecordGlobalLookup();
         return it->second;
     }
-    if(enclosing_ != nullptr) return enclosing_->Get(name);
     throw RuntimeError(name, "Undefined variable '" + name.lexeme() + "'.");
 }
 
@@ -28,12 +28,6 @@ void Environment::Assign(const Token &name, const Object &value)
         return;
     }
 
-    if(enclosing_ != nullptr)
-    {
-        enclosing_->Assign(name, value);
-        return;
-    }
-
     throw RuntimeError(name, "Undefined variable '" + name.lexeme() + "'.");
 }
 
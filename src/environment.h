@@ -3,25 +3,54 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
+#include "gc.h"
 #include "object.h"
+#include "stats.h"
 #include "token.h"
 
 namespace lox
 {
+// Globals, looked up by name. Locals live in the Interpreter's frame slots.
 class Environment
 {
   public:
-    Environment() : enclosing_(nullptr) {}
-    Environment(Environment* enclosing) : enclosing_(enclosing) {}
     void Define(const std::string &name, const Object &value);
     const Object &Get(const Token &name);
     void Assign(const Token& name, const Object& value);
 
+    const std::unordered_map<std::string, Object> &values() const
+    {
+        return values_;
+    }
+
   private:
     std::unordered_map<std::string, Object> values_;
-    Environment* enclosing_;
 };
 
 using EnvironmentUniquePtr = std::unique_ptr<Environment>;
+
+// a local variable captured by a closure, shared by its frame and the closures
+struct Cell : public GcObject
+{
+    explicit Cell(Object value = nullptr) : value(std::move(value))
+    {
+        Stats::RecordCell();
+    }
+
+    void Trace(Heap *heap) override
+    {
+        heap->Mark(value);
+    }
+
+    size_t HeapSize() const override
+    {
+        return sizeof(Cell);
+    }
+
+    Object value;
+};
+
+using CellPtr = Cell *;
 } // namespace lox
\ No newline at end of file
@@ -2,10 +2,57 @@
 
 #include <iostream>
 
+#include "output.h"
+
 namespace lox
 {
-bool had_error = false;
-bool had_runtime_error = false;
+namespace
+{
+thread_local ErrorCapture *capture = nullptr;
+thread_local ErrorState *current_state = nullptr;
+} // namespace
+
+ErrorState &CurrentErrorState()
+{
+    if (current_state == nullptr)
+    {
+        static ErrorState process_state(&std::cerr, &Output::Standard());
+        return process_state;
+    }
+    return *current_state;
+}
+
+ErrorStateScope::ErrorStateScope(ErrorState *state) : previous_(current_state)
+{
+    current_state = state;
+}
+
+ErrorStateScope::~ErrorStateScope()
+{
+    current_state = previous_;
+}
+
+void MarkRuntimeError()
+{
+    if (capture == nullptr)
+    {
+        CurrentErrorState().had_runtime_error = true;
+    }
+    else if (!capture->records_.empty())
+    {
+        capture->records_.back().runtime = true;
+    }
+}
+
+ErrorCapture::ErrorCapture() : previous_(capture)
+{
+    capture = this;
+}
+
+ErrorCapture::~ErrorCapture()
+{
+    capture = previous_;
+}
 
 void Error(Token token, const std::string &message)
 {
@@ -27,19 +74,38 @@ void Error(size_t line, const std::string &message)
 void Error(const ParseError &e)
 {
     Error(e.token(), e.what());
-    had_runtime_error = true;
+    MarkRuntimeError();
 }
 
 void Error(const RuntimeError &e)
 {
     Error(e.token(), e.what());
-    had_runtime_error = true;
+    MarkRuntimeError();
 }
 
 void Report(size_t line, const std::string &where, const std::string &message)
 {
-    std::cerr << "[line " << line << "] Error " + where + ": " + message << std::endl;
-    had_error = true;
+    Replay({"[line " + std::to_string(line) + "] Error " + where + ": " + message});
+}
+
+void Replay(const ErrorRecord &record)
+{
+    if (capture != nullptr)
+    {
+        capture->records_.push_back(record);
+        return;
+    }
+    ErrorState &state = CurrentErrorState();
+    if (state.output != nullptr)
+    {
+        state.output->Sync();
+    }
+    *state.stream << record.message << std::endl;
+    state.had_error = true;
+    if (record.runtime)
+    {
+        state.had_runtime_error = true;
+    }
 }
 
 } // namespace lox
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <ostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "token.h"
 
 namespace lox
 {
+class Output;
 
 class RuntimeError : public std::runtime_error
 {
@@ -35,13 +39,83 @@ class ParseError : public std::runtime_error
     Token token_;
 };
 
+// thrown by native functions, which have no token of their own; the call site
+// rethrows it as a RuntimeError located at the call's closing paren
+class NativeError : public std::runtime_error
+{
+  public:
+    explicit NativeError(const std::string &message) : std::runtime_error(message) {}
+};
+
 void Error(Token token, const std::string &message);
 void Error(size_t line, const std::string &message);
 void Error(const ParseError &e);
 void Error(const RuntimeError &e);
 void Report(size_t line, const std::string &where, const std::string &message);
 
-extern bool had_error;
-extern bool had_runtime_error;
+// one formatted error report, with whether it also marks a runtime error
+struct ErrorRecord
+{
+    std::string message;
+    bool runtime = false;
+};
+
+// Whether a run has reported errors, and where its reports go. Each Lox
+// instance owns one and installs it with an ErrorStateScope while it runs, so
+// the free functions above report to the instance running on the calling
+// thread. Outside any scope they report to a process-wide state printing to
+// std::cerr.
+struct ErrorState
+{
+    ErrorState(std::ostream *stream, Output *output) : stream(stream), output(output) {}
+
+    bool had_error = false;
+    bool had_runtime_error = false;
+    std::ostream *stream;
+    // if set, synced before each report so printed output and errors stay in order
+    Output *output;
+};
+
+ErrorState &CurrentErrorState();
+
+class ErrorStateScope
+{
+  public:
+    explicit ErrorStateScope(ErrorState *state);
+    ~ErrorStateScope();
+    ErrorStateScope(const ErrorStateScope &) = delete;
+    ErrorStateScope &operator=(const ErrorStateScope &) = delete;
+
+  private:
+    ErrorState *previous_;
+};
+
+// While an ErrorCapture is alive, reports made on its thread are recorded
+// instead of printed and leave the current ErrorState untouched. The
+// pipelined front end uses it so the scanner and parser threads can hand their
+// errors to the interpreter thread, which replays them in source order.
+class ErrorCapture
+{
+  public:
+    ErrorCapture();
+    ~ErrorCapture();
+    ErrorCapture(const ErrorCapture &) = delete;
+    ErrorCapture &operator=(const ErrorCapture &) = delete;
+
+    std::vector<ErrorRecord> Take()
+    {
+        return std::move(records_);
+    }
+
+  private:
+    friend void Replay(const ErrorRecord &record);
+    friend void MarkRuntimeError();
+
+    ErrorCapture *previous_;
+    std::vector<ErrorRecord> records_;
+};
+
+// print a captured report (or record it again if this thread is capturing too)
+void Replay(const ErrorRecord &record);
 
 } // namespace lox
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "gc.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "array.h"
+#include "callable.h"
+#include "instance.h"
+#include "list.h"
+#include "map.h"
+#include "stats.h"
+
+namespace lox
+{
+Heap::Tuning Heap::tuning;
+
+Heap::~Heap()
+{
+    for (GcObject *list : {nursery_, old_})
+    {
+        while (list != nullptr)
+        {
+            GcObject *next = list->next_;
+            delete list;
+            list = next;
+        }
+    }
+}
+
+GcObject *Heap::ToGcObject(const Object &value)
+{
+    if (IsObjectInstance<CallablePtr>(value))
+    {
+        return std::get<CallablePtr>(value);
+    }
+    if (IsObjectInstance<InstancePtr>(value))
+    {
+        return std::get<InstancePtr>(value);
+    }
+    if (IsObjectInstance<ArrayPtr>(value))
+    {
+        return std::get<ArrayPtr>(value);
+    }
+    if (IsObjectInstance<ListPtr>(value))
+    {
+        return std::get<ListPtr>(value);
+    }
+    if (IsObjectInstance<MapPtr>(value))
+    {
+        return std::get<MapPtr>(value);
+    }
+    return nullptr;
+}
+
+void Heap::Collect(const std::function<void(Heap *)> &mark_roots)
+{
+    auto begin = std::chrono::steady_clock::now();
+    size_t before = old_bytes_ + nursery_bytes_;
+    major_ = before >= std::max(next_major_, tuning.min_heap_bytes);
+
+    mark_roots(this);
+    if (!major_)
+    {
+        // the only old objects that may point into the nursery
+        for (GcObject *object : remembered_)
+        {
+            object->Trace(this);
+        }
+    }
+    Drain();
+    for (GcObject *object : remembered_)
+    {
+        object->remembered_ = false;
+    }
+    remembered_.clear();
+
+    GcObject *nursery = nursery_;
+    nursery_ = nullptr;
+    nursery_bytes_ = 0;
+    if (major_)
+    {
+        GcObject *old = old_;
+        old_ = nullptr;
+        old_bytes_ = Sweep(old);
+    }
+    old_bytes_ += Sweep(nursery);
+    if (major_)
+    {
+        next_major_ = static_cast<size_t>(static_cast<double>(old_bytes_) * tuning.growth_factor);
+    }
+
+    std::chrono::duration<double> pause = std::chrono::steady_clock::now() - begin;
+    // objects may have grown since they were counted
+    Stats::RecordCollection(major_, pause.count(), before > old_bytes_ ? before - old_bytes_ : 0);
+    major_ = false;
+}
+
+void Heap::Drain()
+{
+    while (!gray_.empty())
+    {
+        GcObject *object = gray_.back();
+        gray_.pop_back();
+        object->Trace(this);
+    }
+}
+
+size_t Heap::Sweep(GcObject *list)
+{
+    size_t survived = 0;
+    while (list != nullptr)
+    {
+        GcObject *next = list->next_;
+        if (list->marked_)
+        {
+            list->marked_ = false;
+            list->old_ = true;
+            list->next_ = old_;
+            old_ = list;
+            survived += list->HeapSize();
+        }
+        else
+        {
+            delete list;
+        }
+        list = next;
+    }
+    return survived;
+}
+} // namespace lox
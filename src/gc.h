@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "object.h"
+
+namespace lox
+{
+class Heap;
+
+// Header of every object the collector manages: functions, classes, instances,
+// arrays, lists, maps and the cells of captured variables. Subclasses report
+// what they point to in Trace() and what they own in HeapSize().
+class GcObject
+{
+  public:
+    GcObject() = default;
+    virtual ~GcObject() = default;
+
+    GcObject(const GcObject &) = delete;
+    GcObject &operator=(const GcObject &) = delete;
+
+    virtual void Trace(Heap *) {}
+    virtual size_t HeapSize() const = 0;
+
+  private:
+    friend class Heap;
+
+    GcObject *next_ = nullptr;
+    bool marked_ = false;
+    bool old_ = false;
+    bool remembered_ = false;
+};
+
+// Precise generational mark-sweep collector.
+//
+// New objects go to the nursery. A minor collection marks from the roots and
+// the remembered set without entering the old generation, frees the dead
+// young objects and promotes the rest, so an old object can only point to a
+// young one after a store into it; stores into cells, fields, lists and maps
+// go through WriteBarrier(), which remembers the old object. A major collection
+// marks and sweeps both generations; it runs instead of a minor one once the
+// old generation outgrows its budget, which is then reset to `growth_factor`
+// times the surviving size.
+//
+// Collection never happens inside Allocate(). The owner polls
+// collection_due() at its safepoints and calls Collect() with a function that
+// marks every root it holds.
+class Heap
+{
+  public:
+    struct Tuning
+    {
+        // bytes allocated in the nursery before a minor collection
+        size_t nursery_bytes = 1 << 20;
+        // the old generation is never collected below this size
+        size_t min_heap_bytes = 8 << 20;
+        double growth_factor = 2.0;
+    };
+
+    // read by every heap; set from the command line before anything runs
+    static Tuning tuning;
+
+    Heap() = default;
+    ~Heap();
+
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+
+    template <typename T, typename... Args>
+    T *Allocate(Args &&...args)
+    {
+        T *object = new T(std::forward<Args>(args)...);
+        object->next_ = nursery_;
+        nursery_ = object;
+        nursery_bytes_ += object->HeapSize();
+        return object;
+    }
+
+    bool collection_due() const
+    {
+        return nursery_bytes_ >= tuning.nursery_bytes;
+    }
+
+    // call after storing `value` into `owner`
+    void WriteBarrier(GcObject *owner, const Object &value)
+    {
+        if (owner->old_ && !owner->remembered_)
+        {
+            GcObject *object = ToGcObject(value);
+            if (object != nullptr && !object->old_)
+            {
+                owner->remembered_ = true;
+                remembered_.push_back(owner);
+            }
+        }
+    }
+
+    // the heap object a value refers to, if any
+    static GcObject *ToGcObject(const Object &value);
+
+    void Collect(const std::function<void(Heap *)> &mark_roots);
+
+    void Mark(GcObject *object)
+    {
+        if (object != nullptr && !object->marked_ && (major_ || !object->old_))
+        {
+            object->marked_ = true;
+            gray_.push_back(object);
+        }
+    }
+
+    void Mark(const Object &value)
+    {
+        Mark(ToGcObject(value));
+    }
+
+  private:
+    void Drain();
+    // frees the unmarked objects of `list` and moves the marked ones to the
+    // old generation, returning the bytes that survived
+    size_t Sweep(GcObject *list);
+
+  private:
+    GcObject *nursery_ = nullptr;
+    GcObject *old_ = nullptr;
+    size_t nursery_bytes_ = 0;
+    size_t old_bytes_ = 0;
+    size_t next_major_ = 0;
+    bool major_ = false;
+    std::vector<GcObject *> gray_;
+    std::vector<GcObject *> remembered_;
+};
+} // namespace lox
@@ -0,0 +1,132 @@
+#include "instance.h"
+
+#include <utility>
+
+#include "interpreter.h"
+
+namespace lox
+{
+std::atomic<uint32_t> Shape::next_id_{1};
+
+Shape::Shape(ClassCallable *klass) : id_(next_id_.fetch_add(1, std::memory_order_relaxed)), klass_(klass) {}
+
+Shape::Shape(const Shape &parent, const std::string &name)
+    : id_(next_id_.fetch_add(1, std::memory_order_relaxed)), klass_(parent.klass_), slots_(parent.slots_)
+{
+    slots_.emplace(name, parent.size());
+}
+
+Shape *Shape::AddField(const std::string &name)
+{
+    std::unique_ptr<Shape> &child = transitions_[name];
+    if (child == nullptr)
+    {
+        child.reset(new Shape(*this, name));
+    }
+    return child.get();
+}
+
+std::vector<const std::string *> Shape::FieldNames() const
+{
+    std::vector<const std::string *> names(slots_.size());
+    for (const auto &[name, slot] : slots_)
+    {
+        names[slot] = &name;
+    }
+    return names;
+}
+
+ClassCallable::ClassCallable(const std::string &name, ClassCallable *superclass)
+    : name_(name), superclass_(superclass), root_shape_(this)
+{
+    if (superclass != nullptr)
+    {
+        methods_ = superclass->methods_;
+        initializer_ = superclass->initializer_;
+    }
+}
+
+Object ClassCallable::Call(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    Instance *instance = interpreter->heap().Allocate<Instance>(&root_shape_);
+    if (initializer_ != nullptr)
+    {
+        initializer_->Invoke(interpreter, instance, arguments);
+    }
+    return instance;
+}
+
+size_t ClassCallable::arity()
+{
+    return initializer_ != nullptr ? initializer_->arity() : 0;
+}
+
+std::string ClassCallable::ToString()
+{
+    return name_;
+}
+
+void ClassCallable::Trace(Heap *heap)
+{
+    heap->Mark(superclass_);
+    for (const auto &[name, method] : methods_)
+    {
+        heap->Mark(method);
+    }
+}
+
+size_t ClassCallable::HeapSize() const
+{
+    return sizeof(ClassCallable) + methods_.size() * (sizeof(std::string) + sizeof(UserDefineCallable *));
+}
+
+void ClassCallable::AddMethod(const std::string &name, UserDefineCallable *method)
+{
+    methods_[name] = method;
+    if (name == "init")
+    {
+        method->set_initializer(true);
+        initializer_ = method;
+    }
+}
+
+std::string Instance::ToString() const
+{
+    return klass()->name() + " instance";
+}
+
+void Instance::Trace(Heap *heap)
+{
+    heap->Mark(klass());
+    for (const Object &value : fields_)
+    {
+        heap->Mark(value);
+    }
+}
+
+size_t Instance::HeapSize() const
+{
+    return sizeof(Instance) + fields_.capacity() * sizeof(Object);
+}
+
+Object BoundMethod::Call(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    return method_->Invoke(interpreter, receiver_, arguments);
+}
+
+size_t BoundMethod::arity()
+{
+    return method_->arity();
+}
+
+std::string BoundMethod::ToString()
+{
+    return method_->ToString();
+}
+
+void BoundMethod::Trace(Heap *heap)
+{
+    heap->Mark(receiver_);
+    heap->Mark(method_);
+}
+} // namespace lox
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "callable.h"
+#include "gc.h"
+#include "object.h"
+
+namespace lox
+{
+class ClassCallable;
+
+// Hidden class: the field layout shared by every instance of a class that got
+// the same fields in the same order. An instance stores its fields in a flat
+// array indexed by the slots of its shape; adding a field moves it to the
+// child shape for that name, created on first use and cached on the parent.
+//
+// A class owns its root shape and through it the whole transition tree, so
+// shapes live exactly as long as their class. Inline caches key on id(),
+// which is never reused.
+class Shape
+{
+  public:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    explicit Shape(ClassCallable *klass);
+
+    Shape(const Shape &) = delete;
+    Shape &operator=(const Shape &) = delete;
+
+    uint32_t id() const
+    {
+        return id_;
+    }
+
+    ClassCallable *klass() const
+    {
+        return klass_;
+    }
+
+    uint32_t size() const
+    {
+        return static_cast<uint32_t>(slots_.size());
+    }
+
+    // slot of the field `name`, or kNoSlot
+    uint32_t Find(const std::string &name) const
+    {
+        auto it = slots_.find(name);
+        return it != slots_.end() ? it->second : kNoSlot;
+    }
+
+    // this shape plus `name` as the next slot
+    Shape *AddField(const std::string &name);
+
+    // field names indexed by slot
+    std::vector<const std::string *> FieldNames() const;
+
+  private:
+    Shape(const Shape &parent, const std::string &name);
+
+  private:
+    uint32_t id_;
+    ClassCallable *klass_;
+    std::unordered_map<std::string, uint32_t> slots_;
+    std::unordered_map<std::string, std::unique_ptr<Shape>> transitions_;
+
+    static std::atomic<uint32_t> next_id_;
+};
+
+class ClassCallable : public Callable
+{
+  public:
+    // starts with the superclass's methods, which AddMethod() may override
+    ClassCallable(const std::string &name, ClassCallable *superclass);
+
+    // creates an instance and runs `init` on it
+    Object Call(Interpreter *interpreter, const std::vector<Object> &arguments) override;
+
+    size_t arity() override;
+
+    std::string ToString() override;
+
+    void Trace(Heap *heap) override;
+    size_t HeapSize() const override;
+
+    const std::string &name() const
+    {
+        return name_;
+    }
+
+    ClassCallable *superclass() const
+    {
+        return superclass_;
+    }
+
+    Shape *root_shape()
+    {
+        return &root_shape_;
+    }
+
+    // own or inherited, nullptr if there is none
+    UserDefineCallable *FindMethod(const std::string &name) const
+    {
+        auto it = methods_.find(name);
+        return it != methods_.end() ? it->second : nullptr;
+    }
+
+    void AddMethod(const std::string &name, UserDefineCallable *method);
+
+    const std::unordered_map<std::string, UserDefineCallable *> &methods() const
+    {
+        return methods_;
+    }
+
+  private:
+    std::string name_;
+    ClassCallable *superclass_;
+    std::unordered_map<std::string, UserDefineCallable *> methods_;
+    UserDefineCallable *initializer_ = nullptr;
+    Shape root_shape_;
+};
+
+class Instance : public GcObject
+{
+  public:
+    explicit Instance(Shape *shape) : shape_(shape) {}
+
+    Shape *shape() const
+    {
+        return shape_;
+    }
+
+    ClassCallable *klass() const
+    {
+        return shape_->klass();
+    }
+
+    Object &field(uint32_t slot)
+    {
+        return fields_[slot];
+    }
+
+    // moves to `shape`, which must be the current shape plus one field
+    void AddField(Shape *shape, Object value)
+    {
+        shape_ = shape;
+        fields_.push_back(std::move(value));
+    }
+
+    std::string ToString() const;
+
+    void Trace(Heap *heap) override;
+    size_t HeapSize() const override;
+
+  private:
+    Shape *shape_;
+    std::vector<Object> fields_;
+};
+
+// a method read off an instance as a value, `this` already bound
+class BoundMethod : public Callable
+{
+  public:
+    BoundMethod(Instance *receiver, UserDefineCallable *method) : receiver_(receiver), method_(method) {}
+
+    Object Call(Interpreter *interpreter, const std::vector<Object> &arguments) override;
+
+    size_t arity() override;
+
+    std::string ToString() override;
+
+    void Trace(Heap *heap) override;
+
+    size_t HeapSize() const override
+    {
+        return sizeof(BoundMethod);
+    }
+
+    Instance *receiver() const
+    {
+        return receiver_;
+    }
+
+    UserDefineCallable *method() const
+    {
+        return method_;
+    }
+
+  private:
+    Instance *receiver_;
+    UserDefineCallable *method_;
+};
+} // namespace lox
@@ -1,20 +1,36 @@
 #include "interpreter.h"
 
-#include <iostream>
 #include <chrono>
+#include <filesystem>
 #include <memory>
+#include <utility>
 
+#include "array.h"
 #include "ast.h"
+#include "bench.h"
 #include "callable.h"
 #include "control_exception.h"
 #include "environment.h"
 #include "error.h"
+#include "instance.h"
+#include "list.h"
+#include "map.h"
 #include "object.h"
+#include "profiler.h"
+#include "stats.h"
 
 using namespace lox;
 using namespace lox::expr;
 using namespace lox::stmt;
 
+namespace
+{
+// enough stack for ordinary call depths without growing mid-run
+constexpr size_t kInitialLocals = 1024;
+constexpr size_t kInitialCells = 128;
+constexpr size_t kInitialOperands = 64;
+} // namespace
+
 Object clock_func(Interpreter*, const std::vector<Object>&)
 {
     auto now = std::chrono::system_clock::now();
@@ -25,9 +41,16 @@ Object clock_func(Interpreter*, const std::vector<Object>&)
 
 Interpreter::Interpreter() : globals_(std::make_unique<Environment>())
 {
-    globals_->Define("clock", std::make_shared<BuiltinCallable>("clock", clock_func, 0));
-
-    environment_ = globals_.get();
+    globals_->Define("clock", heap_.Allocate<BuiltinCallable>("clock", clock_func, 0));
+    globals_->Define("bench", heap_.Allocate<BuiltinCallable>("bench", BenchFunc, 2));
+    globals_->Define("assertNoAlloc", heap_.Allocate<BuiltinCallable>("assertNoAlloc", AssertNoAllocFunc, 1));
+    DefineArrayFunctions(&heap_, globals_.get());
+    DefineListFunctions(&heap_, globals_.get());
+    DefineMapFunctions(&heap_, globals_.get());
+
+    locals_.reserve(kInitialLocals);
+    cells_.reserve(kInitialCells);
+    operands_.reserve(kInitialOperands);
 }
 
 void Interpreter::Interpret(const Program &program)
@@ -49,9 +72,39 @@ void Interpreter::Interpret(const Program &program)
     }
 }
 
+void Interpreter::Interpret(stmt::Stmt *statement)
+{
+    try
+    {
+        Execute(statement);
+    }
+    catch (const RuntimeError &e)
+    {
+        lox::Error(e);
+    }
+    catch (const control::Return& e)
+    {
+        lox::Error(e.keyword(), "'return' outside function");
+    }
+}
+
+void Interpreter::Retain(Program program)
+{
+    retained_.push_back(std::move(program));
+}
+
+void Interpreter::Discard(StmtUniquePtr)
+{
+    // the profiler's samples may point into the statement
+    Profiler::Enter(nullptr);
+    Profiler::Collect();
+}
+
 Object Interpreter::Visit(Binary *expr)
 {
     Object left = Evaluate(expr->left());
+    OperandScope operands(this);
+    operands.Push(left);
     Object right = Evaluate(expr->right());
 
     switch (expr->oper().type())
@@ -79,7 +132,10 @@ Object Interpreter::Visit(Binary *expr)
         }
         if (IsObjectInstance<std::string>(left) && IsObjectInstance<std::string>(right))
         {
-            return std::get<std::string>(left) + std::get<std::string>(right);
+            // left is our own copy, so grow it in place rather than building a third string
+            std::string &result = std::get<std::string>(left);
+            result += std::get<std::string>(right);
+            return std::move(result);
         }
         throw RuntimeError(expr->oper(), "Operands must be two numbers or two strings.");
     case Token::Type::kMinus:
@@ -127,13 +183,13 @@ Object Interpreter::Visit(Unary *expr)
 
 Object Interpreter::Visit(Variable *expr)
 {
-    return environment_->Get(expr->name());
+    return LookUpVariable(expr->slot(), expr->name());
 }
 
 Object Interpreter::Visit(Assign *expr)
 {
     Object value = Evaluate(expr->value());
-    environment_->Assign(expr->name(), value);
+    AssignVariable(expr->slot(), expr->name(), value);
     return value;
 }
 
@@ -161,17 +217,63 @@ Object Interpreter::Visit(Logical *expr)
 
 Object Interpreter::Visit(Call *expr)
 {
-    Object callee = Evaluate(expr->callee());
+    Get *property = expr->method();
+    if (property == nullptr)
+    {
+        Object callee = Evaluate(expr->callee());
+        OperandScope operands(this);
+        operands.Push(callee);
+
+        std::vector<Object> arguments;
+        for (const ExprUniquePtr &argument : expr->arguments())
+        {
+            arguments.push_back(Evaluate(argument.get()));
+            operands.Push(arguments.back());
+        }
+        return CallValue(callee, arguments, expr->paren());
+    }
+
+    // a.b(...): a method found through the cache is invoked on a directly, with no bound method in between
+    Object object = Evaluate(property->object());
+    if (!IsObjectInstance<InstancePtr>(object))
+    {
+        throw RuntimeError(property->name(), "Only instances have properties.");
+    }
+    Instance *instance = std::get<InstancePtr>(object);
+    OperandScope operands(this);
+    operands.Push(object);
+
+    UserDefineCallable *method = nullptr;
+    const Object *field = FindProperty(instance, property->name(), property_cache(property->site()), &method);
+    Object callee = field != nullptr ? *field : nullptr;
+    operands.Push(callee);
 
     std::vector<Object> arguments;
     for (const ExprUniquePtr &argument : expr->arguments())
     {
         arguments.push_back(Evaluate(argument.get()));
+        operands.Push(arguments.back());
+    }
+    if (method == nullptr)
+    {
+        return CallValue(callee, arguments, expr->paren());
     }
 
+    if (method->arity() != arguments.size())
+    {
+        throw RuntimeError(
+            expr->paren(), "Expected " + std::to_string(method->arity()) + " arguments but got " +
+                               std::to_string(arguments.size()) + "."
+        );
+    }
+    return method->Invoke(this, instance, arguments);
+}
+
+Object Interpreter::CallValue(const Object &callee, const std::vector<Object> &arguments, const Token &paren)
+{
     if (IsObjectInstance<CallablePtr>(callee) == false)
     {
-        throw RuntimeError(expr->paren(), "Can only call functions and classes");
+        throw RuntimeError(paren, "Can only call functions and classes");
     }
 
     CallablePtr function = std::get<CallablePtr>(callee);
@@ -179,12 +281,129 @@ Object Interpreter::Visit(Call *expr)
     if (function->arity() != arguments.size())
     {
         throw RuntimeError(
-            expr->paren(), "Expected " + std::to_string(function->arity()) + " arguments but got " +
-                               std::to_string(arguments.size()) + "."
+            paren, "Expected " + std::to_string(function->arity()) + " arguments but got " +
+                       std::to_string(arguments.size()) + "."
         );
     }
 
-    return function->Call(this, arguments);
+    try
+    {
+        return function->Call(this, arguments);
+    }
+    catch (const NativeError &e)
+    {
+        throw RuntimeError(paren, e.what());
+    }
+}
+
+Object Interpreter::Visit(Get *expr)
+{
+    Object object = Evaluate(expr->object());
+    if (!IsObjectInstance<InstancePtr>(object))
+    {
+        throw RuntimeError(expr->name(), "Only instances have properties.");
+    }
+    Instance *instance = std::get<InstancePtr>(object);
+
+    UserDefineCallable *method = nullptr;
+    const Object *field = FindProperty(instance, expr->name(), property_cache(expr->site()), &method);
+    if (field != nullptr)
+    {
+        return *field;
+    }
+    return static_cast<CallablePtr>(heap_.Allocate<BoundMethod>(instance, method));
+}
+
+Object Interpreter::Visit(Set *expr)
+{
+    Object object = Evaluate(expr->object());
+    if (!IsObjectInstance<InstancePtr>(object))
+    {
+        throw RuntimeError(expr->name(), "Only instances have fields.");
+    }
+    Instance *instance = std::get<InstancePtr>(object);
+    OperandScope operands(this);
+    operands.Push(object);
+
+    Object value = Evaluate(expr->value());
+
+    // the shape is read after the value, which may itself have added fields
+    Shape *shape = instance->shape();
+    PropertyCache &cache = property_cache(expr->site());
+    const PropertyCache::Entry *entry = cache.Find(shape->id());
+    PropertyCache::Entry added;
+    if (entry == nullptr)
+    {
+        added.shape = shape->id();
+        added.slot = shape->Find(expr->name().lexeme());
+        if (added.slot == Shape::kNoSlot)
+        {
+            added.transition = shape->AddField(expr->name().lexeme());
+            added.slot = shape->size();
+        }
+        cache.Add(added);
+        entry = &added;
+    }
+
+    if (entry->transition != nullptr)
+    {
+        instance->AddField(entry->transition, value);
+    }
+    else
+    {
+        instance->field(entry->slot) = value;
+    }
+    heap_.WriteBarrier(instance, value);
+    return value;
+}
+
+Object Interpreter::Visit(This *expr)
+{
+    return LookUpVariable(expr->slot(), expr->keyword());
+}
+
+Object Interpreter::Visit(Super *expr)
+{
+    const Object &superclass = LookUpVariable(expr->slot(), expr->keyword());
+    const Object &receiver = LookUpVariable(expr->this_slot(), expr->keyword());
+    // Visit(Class) only binds super to a class
+    auto *klass = static_cast<ClassCallable *>(std::get<CallablePtr>(superclass));
+
+    UserDefineCallable *method = klass->FindMethod(expr->method().lexeme());
+    if (method == nullptr)
+    {
+        throw RuntimeError(expr->method(), "Undefined property '" + expr->method().lexeme() + "'.");
+    }
+    return static_cast<CallablePtr>(heap_.Allocate<BoundMethod>(std::get<InstancePtr>(receiver), method));
+}
+
+const Object *Interpreter::FindProperty(
+    Instance *instance, const Token &name, PropertyCache &cache, UserDefineCallable **method
+)
+{
+    Shape *shape = instance->shape();
+    const PropertyCache::Entry *entry = cache.Find(shape->id());
+    if (entry == nullptr)
+    {
+        // fields shadow methods
+        PropertyCache::Entry added;
+        added.shape = shape->id();
+        added.slot = shape->Find(name.lexeme());
+        if (added.slot == Shape::kNoSlot)
+        {
+            added.method = instance->klass()->FindMethod(name.lexeme());
+            if (added.method == nullptr)
+            {
+                throw RuntimeError(name, "Undefined property '" + name.lexeme() + "'.");
+            }
+        }
+        cache.Add(added);
+        *method = added.method;
+        return added.method != nullptr ? nullptr : &instance->field(added.slot);
+    }
+
+    *method = entry->method;
+    return entry->method != nullptr ? nullptr : &instance->field(entry->slot);
 }
 
 Object Interpreter::Visit(Expression *stmt)
@@ -196,7 +415,8 @@ Object Interpreter::Visit(Expression *stmt)
 Object Interpreter::Visit(Print *stmt)
 {
     Object value = Evaluate(stmt->expression());
-    std::cout << ObjectToString(value) << std::endl;
+    AppendObject(output_->buffer(), value);
+    output_->EndLine();
     return nullptr;
 }
 
@@ -208,14 +428,13 @@ Object Interpreter::Visit(Var *stmt)
         value = Evaluate(stmt->initializer());
     }
 
-    environment_->Define(stmt->name().lexeme(), value);
+    DefineVariable(stmt->slot(), stmt->name(), value);
     return nullptr;
 }
 
 Object Interpreter::Visit(Block *stmt)
 {
-    auto enclosing_environment = std::make_unique<Environment>(environment_);
-    ExecuteBlock(stmt->statements(), enclosing_environment.get());
+    ExecuteBlock(stmt->statements());
     return nullptr;
 }
 
@@ -243,11 +462,132 @@ Object Interpreter::Visit(While *stmt)
 
 Object Interpreter::Visit(Function *stmt)
 {
-    CallablePtr function = std::make_shared<UserDefineCallable>(stmt);
-    environment_->Define(stmt->name().lexeme(), function);
+    // a captured function's cell exists before the closure, so it can capture itself
+    bool in_cell = stmt->slot().kind == VariableSlot::Kind::kCell;
+    if (in_cell)
+    {
+        DefineVariable(stmt->slot(), stmt->name(), nullptr);
+    }
+
+    CallablePtr function = heap_.Allocate<UserDefineCallable>(stmt, CaptureUpvalues(stmt));
+    Stats::RecordCallable();
+    if (in_cell)
+    {
+        AssignVariable(stmt->slot(), stmt->name(), function);
+    }
+    else
+    {
+        DefineVariable(stmt->slot(), stmt->name(), function);
+    }
+    return nullptr;
+}
+
+Object Interpreter::Visit(Class *stmt)
+{
+    ClassCallable *superclass = nullptr;
+    if (stmt->superclass() != nullptr)
+    {
+        Object value = Evaluate(stmt->superclass());
+        if (IsObjectInstance<CallablePtr>(value))
+        {
+            superclass = dynamic_cast<ClassCallable *>(std::get<CallablePtr>(value));
+        }
+        if (superclass == nullptr)
+        {
+            throw RuntimeError(stmt->superclass()->name(), "Superclass must be a class.");
+        }
+    }
+
+    // like a function, the class's cell exists before the methods capture it
+    bool in_cell = stmt->slot().kind == VariableSlot::Kind::kCell;
+    if (in_cell)
+    {
+        DefineVariable(stmt->slot(), stmt->name(), nullptr);
+    }
+    if (superclass != nullptr)
+    {
+        DefineVariable(stmt->super_slot(), stmt->superclass()->name(), static_cast<CallablePtr>(superclass));
+    }
+
+    auto *klass = heap_.Allocate<ClassCallable>(stmt->name().lexeme(), superclass);
+    for (const FunctionUniquePtr &method : stmt->methods())
+    {
+        klass->AddMethod(
+            method->name().lexeme(), heap_.Allocate<UserDefineCallable>(method.get(), CaptureUpvalues(method.get()))
+        );
+        Stats::RecordCallable();
+    }
+
+    if (in_cell)
+    {
+        AssignVariable(stmt->slot(), stmt->name(), static_cast<CallablePtr>(klass));
+    }
+    else
+    {
+        DefineVariable(stmt->slot(), stmt->name(), static_cast<CallablePtr>(klass));
+    }
+    return nullptr;
+}
+
+void Interpreter::set_script_path(const std::string &path)
+{
+    std::string canonical = Modules::Resolve("", path);
+    module_directory_ = std::filesystem::path(canonical).parent_path().string();
+    imported_.insert(std::move(canonical));
+}
+
+Object Interpreter::Visit(Import *stmt)
+{
+    std::string path = Modules::Resolve(module_directory_, stmt->path());
+    if (!imported_.insert(path).second)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<const Modules::Module> module = Modules::Load(path);
+    if (module == nullptr)
+    {
+        throw RuntimeError(stmt->path_token(), "Can not open module '" + stmt->path() + "'.");
+    }
+    for (const ErrorRecord &record : module->errors)
+    {
+        Replay(record);
+    }
+    if (!module->errors.empty())
+    {
+        throw RuntimeError(stmt->path_token(), "Can not compile module '" + stmt->path() + "'.");
+    }
+    modules_.push_back(module);
+
+    // imports are top-level only, so the module's top level runs in the frame
+    // of the importing one
+    std::string directory = std::exchange(module_directory_, module->directory);
+    try
+    {
+        for (const StmtUniquePtr &statement : module->program)
+        {
+            Execute(statement.get());
+        }
+    }
+    catch (...)
+    {
+        module_directory_ = std::move(directory);
+        throw;
+    }
+    module_directory_ = std::move(directory);
     return nullptr;
 }
 
+std::vector<CellPtr> Interpreter::CaptureUpvalues(stmt::Function *function)
+{
+    std::vector<CellPtr> upvalues;
+    upvalues.reserve(function->upvalues().size());
+    for (const UpvalueSource &source : function->upvalues())
+    {
+        upvalues.push_back(source.from_cell ? cells_[cell_base_ + source.index] : (*upvalues_)[source.index]);
+    }
+    return upvalues;
+}
+
 Object Interpreter::Visit(Return *stmt)
 {
     Object value = nullptr;
@@ -294,6 +634,22 @@ bool Interpreter::IsEqual(const Object &a, const Object &b)
     {
         return std::get<bool>(a) == std::get<bool>(b);
     }
+    if (IsObjectInstance<InstancePtr>(a) && IsObjectInstance<InstancePtr>(b))
+    {
+        return std::get<InstancePtr>(a) == std::get<InstancePtr>(b);
+    }
+    if (IsObjectInstance<ArrayPtr>(a) && IsObjectInstance<ArrayPtr>(b))
+    {
+        return std::get<ArrayPtr>(a) == std::get<ArrayPtr>(b);
+    }
+    if (IsObjectInstance<ListPtr>(a) && IsObjectInstance<ListPtr>(b))
+    {
+        return std::get<ListPtr>(a) == std::get<ListPtr>(b);
+    }
+    if (IsObjectInstance<MapPtr>(a) && IsObjectInstance<MapPtr>(b))
+    {
+        return std::get<MapPtr>(a) == std::get<MapPtr>(b);
+    }
     return false;
 }
 
@@ -319,16 +675,59 @@ Object Interpreter::Evaluate(Expr *expr)
 
 void Interpreter::Execute(stmt::Stmt *stmt)
 {
+    // statement boundaries are the collector's safepoints, and where an
+    // interrupt takes effect
+    if (heap_.collection_due())
+    {
+        CollectGarbage();
+    }
+    if (interrupt_->load(std::memory_order_relaxed))
+    {
+        throw control::Interrupt();
+    }
+    if (Profiler::enabled())
+    {
+        Profiler::Enter(stmt);
+    }
     stmt->Accept(this);
 }
 
-void Interpreter::ExecuteBlock(const StmtList &statements, Environment* environment)
+void Interpreter::CollectGarbage()
 {
-    Environment* previous = environment_;
-    try
+    heap_.Collect([this](Heap *heap) { MarkRoots(heap); });
+}
+
+void Interpreter::MarkRoots(Heap *heap)
+{
+    for (const auto &[name, value] : globals_->values())
+    {
+        heap->Mark(value);
+    }
+    for (const Object &value : locals_)
+    {
+        heap->Mark(value);
+    }
+    for (Cell *cell : cells_)
+    {
+        heap->Mark(cell);
+    }
+    if (upvalues_ != nullptr)
     {
-        environment_ = environment;
+        for (Cell *cell : *upvalues_)
+        {
+            heap->Mark(cell);
+        }
+    }
+    for (GcObject *object : operands_)
+    {
+        heap->Mark(object);
+    }
+}
 
+void Interpreter::ExecuteBlock(const StmtList &statements)
+{
+    try
+    {
         for (const StmtUniquePtr &statement : statements)
         {
             Execute(statement.get());
@@ -342,10 +741,98 @@ void Interpreter::ExecuteBlock(const StmtList &statements, Environment* environm
     {
         lox::Error(e);
     }
-    catch (...)
+}
+
+const Object &Interpreter::LookUpVariable(const VariableSlot &slot, const Token &name)
+{
+    switch (slot.kind)
     {
-        environment_ = previous;
-        throw;
+    case VariableSlot::Kind::kLocal:
+        return locals_[local_base_ + slot.index];
+    case VariableSlot::Kind::kCell:
+        return cells_[cell_base_ + slot.index]->value;
+    case VariableSlot::Kind::kUpvalue:
+        return (*upvalues_)[slot.index]->value;
+    case VariableSlot::Kind::kGlobal:
+        break;
     }
-    environment_ = previous;
+    return globals_->Get(name);
+}
+
+void Interpreter::DefineVariable(const VariableSlot &slot, const Token &name, const Object &value)
+{
+    switch (slot.kind)
+    {
+    case VariableSlot::Kind::kLocal:
+    {
+        size_t index = local_base_ + slot.index;
+        if (index >= locals_.size())
+        {
+            locals_.resize(index + 1);
+        }
+        locals_[index] = value;
+        return;
+    }
+    case VariableSlot::Kind::kCell:
+    {
+        // every declaration gets a fresh cell, so each loop iteration's closures see their own variable
+        size_t index = cell_base_ + slot.index;
+        if (index >= cells_.size())
+        {
+            cells_.resize(index + 1);
+        }
+        cells_[index] = heap_.Allocate<Cell>(value);
+        return;
+    }
+    case VariableSlot::Kind::kUpvalue:
+    case VariableSlot::Kind::kGlobal:
+        break;
+    }
+    globals_->Define(name.lexeme(), value);
+}
+
+void Interpreter::AssignVariable(const VariableSlot &slot, const Token &name, const Object &value)
+{
+    switch (slot.kind)
+    {
+    case VariableSlot::Kind::kLocal:
+        locals_[local_base_ + slot.index] = value;
+        return;
+    case VariableSlot::Kind::kCell:
+    {
+        Cell *cell = cells_[cell_base_ + slot.index];
+        cell->value = value;
+        heap_.WriteBarrier(cell, value);
+        return;
+    }
+    case VariableSlot::Kind::kUpvalue:
+    {
+        Cell *cell = (*upvalues_)[slot.index];
+        cell->value = value;
+        heap_.WriteBarrier(cell, value);
+        return;
+    }
+    case VariableSlot::Kind::kGlobal:
+        break;
+    }
+    globals_->Assign(name, value);
+}
+
+CallFrame::CallFrame(Interpreter *interpreter, const std::vector<CellPtr> *upvalues)
+    : interpreter_(interpreter), local_base_(interpreter->local_base_), cell_base_(interpreter->cell_base_),
+      upvalues_(interpreter->upvalues_)
+{
+    interpreter->local_base_ = interpreter->locals_.size();
+    interpreter->cell_base_ = interpreter->cells_.size();
+    interpreter->upvalues_ = upvalues;
+    Stats::RecordFrame();
+}
+
+CallFrame::~CallFrame()
+{
+    interpreter_->locals_.resize(interpreter_->local_base_);
+    interpreter_->cells_.resize(interpreter_->cell_base_);
+    interpreter_->local_base_ = local_base_;
+    interpreter_->cell_base_ = cell_base_;
+    interpreter_->upvalues_ = upvalues_;
 }
\ No newline at end of file
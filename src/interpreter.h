@@ -1,8 +1,15 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "ast.h"
 #include "environment.h"
+#include "gc.h"
+#include "modules.h"
+#include "output.h"
 #include "token.h"
 
 namespace lox
@@ -11,7 +18,10 @@ class Interpreter : public expr::ExprVisitor, stmt::StmtVisitor
 {
   public:
     Interpreter();
+    virtual ~Interpreter() = default;
     void Interpret(const Program &program);
+    // one top-level statement, for the streaming pipeline
+    void Interpret(stmt::Stmt *statement);
 
     Object Visit(expr::Binary *expr) override;
     Object Visit(expr::Grouping *expr) override;
@@ -21,6 +31,10 @@ class Interpreter : public expr::ExprVisitor, stmt::StmtVisitor
     Object Visit(expr::Assign *expr) override;
     Object Visit(expr::Logical *expr) override;
     Object Visit(expr::Call* expr) override;
+    Object Visit(expr::Get *expr) override;
+    Object Visit(expr::Set *expr) override;
+    Object Visit(expr::This *expr) override;
+    Object Visit(expr::Super *expr) override;
 
     Object Visit(stmt::Expression *stmt) override;
     Object Visit(stmt::Print *stmt) override;
@@ -30,20 +44,169 @@ class Interpreter : public expr::ExprVisitor, stmt::StmtVisitor
     Object Visit(stmt::While *stmt) override;
     Object Visit(stmt::Function *stmt) override;
     Object Visit(stmt::Return *strm) override;
+    Object Visit(stmt::Class *stmt) override;
+    Object Visit(stmt::Import *stmt) override;
 
     void Execute(stmt::Stmt *stmt);
-    void ExecuteBlock(const StmtList &statements, Environment* environment);
+    void ExecuteBlock(const StmtList &statements);
+
+    // variable access through a slot filled in by the Resolver
+    const Object &LookUpVariable(const VariableSlot &slot, const Token &name);
+    void DefineVariable(const VariableSlot &slot, const Token &name, const Object &value);
+    void AssignVariable(const VariableSlot &slot, const Token &name, const Object &value);
 
     Environment* globals() { return globals_.get(); }
 
+    Heap &heap() { return heap_; }
+    // runs a collection now; Execute() starts one by itself whenever the heap asks
+    void CollectGarbage();
+
+    // keeps an executed program alive for the functions that point into it
+    void Retain(Program program);
+    // a top-level statement that has run and declares nothing that outlives
+    // it; dropped unless a subclass still refers to its nodes
+    virtual void Discard(StmtUniquePtr statement);
+
+    // what the imports of the running script are relative to; empty for the
+    // working directory
+    const std::string &module_directory() const { return module_directory_; }
+    // the running script's file: its imports are relative to its directory,
+    // and importing the script itself does nothing
+    void set_script_path(const std::string &path);
+
+    // stops the running program at its next statement by throwing
+    // control::Interrupt; safe to call from any thread
+    void Interrupt() { interrupt_->store(true, std::memory_order_relaxed); }
+    bool interrupted() const { return interrupt_->load(std::memory_order_relaxed); }
+    // for a worker running part of a call made on `owner`: interrupting
+    // `owner` stops this Interpreter as well
+    void ShareInterrupt(Interpreter *owner) { interrupt_ = owner->interrupt_; }
+
+    Output &output() { return *output_; }
+    void set_output(Output *output) { output_ = output; }
+
+    // false for nil and false, true for everything else
+    static bool IsTruthy(const Object &obj);
+
   private:
-    bool IsTruthy(const Object &obj);
     bool IsEqual(const Object &left, const Object &right);
     void CheckNumberOperands(const Token &oper, std::initializer_list<Object> objs);
 
     Object Evaluate(expr::Expr *expr);
+
+    // the cells a new closure of `function` captures from the running frame
+    std::vector<CellPtr> CaptureUpvalues(stmt::Function *function);
+
+    PropertyCache &property_cache(const PropertySite &site)
+    {
+        size_t page = site.index() / kPropertyCachePage;
+        if (page >= property_caches_.size())
+        {
+            property_caches_.resize(page + 1);
+        }
+        if (property_caches_[page] == nullptr)
+        {
+            property_caches_[page] = std::make_unique<PropertyCache[]>(kPropertyCachePage);
+        }
+        PropertyCache &cache = property_caches_[page][site.index() % kPropertyCachePage];
+        if (cache.generation != site.generation())
+        {
+            cache = PropertyCache();
+            cache.generation = site.generation();
+        }
+        return cache;
+    }
+
+    // property lookup through the site's inline cache; a method is returned
+    // through `method` rather than bound, the caller decides whether to bind it
+    const Object *FindProperty(
+        Instance *instance, const Token &name, PropertyCache &cache, UserDefineCallable **method
+    );
+    Object CallValue(const Object &callee, const std::vector<Object> &arguments, const Token &paren);
+  private:
+    friend class CallFrame;
+    friend class OperandScope;
+
+    void MarkRoots(Heap *heap);
+
   private:
+    Heap heap_;
     std::unique_ptr<Environment> globals_;
-    Environment* environment_;
+    std::vector<Program> retained_;
+    // every module imported so far, by path, and their programs kept alive
+    std::unordered_set<std::string> imported_;
+    std::vector<std::shared_ptr<const Modules::Module>> modules_;
+    std::string module_directory_;
+    Output *output_ = &Output::Standard();
+    std::atomic<bool> interrupted_{false};
+    // the flag Interrupt() sets and statements check, that of the owner for a worker
+    std::atomic<bool> *interrupt_ = &interrupted_;
+
+    // frame slots of every active call, and the cells of their captured locals;
+    // a frame grows on demand as its variables are defined
+    std::vector<Object> locals_;
+    std::vector<CellPtr> cells_;
+    size_t local_base_ = 0;
+    size_t cell_base_ = 0;
+    const std::vector<CellPtr> *upvalues_ = nullptr;
+
+    // heap values that C++ code holds across a nested evaluation, such as a
+    // call's callee and arguments; roots like the slots above
+    std::vector<GcObject *> operands_;
+
+    // inline caches by property site, in pages allocated as sites are first run
+    static constexpr size_t kPropertyCachePage = 256;
+    std::vector<std::unique_ptr<PropertyCache[]>> property_caches_;
+};
+
+// One activation of a user function: fresh slot and cell space on top of the
+// interpreter's stacks and the closure's upvalues, all released on exit.
+class CallFrame
+{
+  public:
+    CallFrame(Interpreter *interpreter, const std::vector<CellPtr> *upvalues);
+    ~CallFrame();
+
+    CallFrame(const CallFrame &) = delete;
+    CallFrame &operator=(const CallFrame &) = delete;
+
+  private:
+    Interpreter *interpreter_;
+    size_t local_base_;
+    size_t cell_base_;
+    const std::vector<CellPtr> *upvalues_;
+};
+
+// Roots the heap values pushed while it is alive. Collections only start
+// between statements, so a value needs this only while statements can run
+// before it is used: during the evaluation of a later operand or a call, or
+// while a native calls back into Lox.
+class OperandScope
+{
+  public:
+    explicit OperandScope(Interpreter *interpreter)
+        : interpreter_(interpreter), size_(interpreter->operands_.size())
+    {
+    }
+
+    ~OperandScope()
+    {
+        interpreter_->operands_.resize(size_);
+    }
+
+    OperandScope(const OperandScope &) = delete;
+    OperandScope &operator=(const OperandScope &) = delete;
+
+    void Push(const Object &value)
+    {
+        if (GcObject *object = Heap::ToGcObject(value))
+        {
+            interpreter_->operands_.push_back(object);
+        }
+    }
+
+  private:
+    Interpreter *interpreter_;
+    size_t size_;
 };
 } // namespace lox
\ No newline at end of file
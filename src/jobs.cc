@@ -0,0 +1,104 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "interpreter.h"
+#include "lox.h"
+#include "output.h"
+#include "snapshot.h"
+
+namespace lox
+{
+namespace
+{
+struct Job
+{
+    Output output;
+    std::ostringstream errors;
+    int status = 0;
+    bool done = false;
+};
+
+void RunJob(const std::string &script, const std::string &snapshot_path, Job *job)
+{
+    try
+    {
+        Lox lox(std::make_unique<Interpreter>(), &job->output, job->errors);
+        if (!snapshot_path.empty() && !Snapshot::Restore(lox.interpreter(), snapshot_path))
+        {
+            job->errors << "can not load snapshot: " + snapshot_path << std::endl;
+            job->status = 66;
+            return;
+        }
+        job->status = lox.RunFile(script);
+    }
+    catch (const std::exception &e)
+    {
+        // out of memory or threads; the other jobs carry on
+        job->errors << script << ": " << e.what() << std::endl;
+        job->status = 70;
+    }
+}
+} // namespace
+
+int RunJobs(const std::vector<std::string> &scripts, size_t jobs, const std::string &snapshot_path)
+{
+    std::vector<Job> results(scripts.size());
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    auto work = [&] {
+        for (size_t i = next++; i < scripts.size(); i = next++)
+        {
+            RunJob(scripts[i], snapshot_path, &results[i]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i].done = true;
+            }
+            finished.notify_one();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::clamp<size_t>(jobs, 1, scripts.size()); i++)
+    {
+        threads.emplace_back(work);
+    }
+
+    int status = 0;
+    Output &out = Output::Standard();
+    for (size_t i = 0; i < scripts.size(); i++)
+    {
+        Job &job = results[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return job.done; });
+        }
+        out.Write(job.output.buffer());
+        job.output.buffer().clear();
+        out.Sync();
+        std::cerr << job.errors.str();
+        if (job.status != 0)
+        {
+            std::cerr << "lox-cpp: " << scripts[i] << " exited with status " << job.status << std::endl;
+            if (status == 0)
+            {
+                status = job.status;
+            }
+        }
+    }
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return status;
+}
+} // namespace lox
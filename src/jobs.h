@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lox
+{
+// Batch mode behind --jobs=N: runs each script in a fresh Lox instance, up to
+// `jobs` of them at once on their own threads. A job prints into memory; the
+// calling thread writes a job's output and errors out once it and every
+// script before it have finished, so the combined output reads as if the
+// scripts had run one after another. With a snapshot every job starts from
+// it. Returns the status of the first script that failed, or 0.
+int RunJobs(const std::vector<std::string> &scripts, size_t jobs, const std::string &snapshot_path);
+} // namespace lox
@@ -0,0 +1,139 @@
+#include "line_finder.h"
+
+namespace lox
+{
+using namespace expr;
+using namespace stmt;
+
+namespace
+{
+class LineFinder : public ExprVisitor, public StmtVisitor
+{
+  public:
+    size_t Find(Expr *expr)
+    {
+        return static_cast<size_t>(std::get<double>(expr->Accept(this)));
+    }
+    size_t Find(Stmt *stmt)
+    {
+        return static_cast<size_t>(std::get<double>(stmt->Accept(this)));
+    }
+
+    Object Visit(Binary *expr) override
+    {
+        return Either(Find(expr->left()), expr->oper());
+    }
+    Object Visit(Grouping *expr) override
+    {
+        return static_cast<double>(Find(expr->expression()));
+    }
+    Object Visit(Literal *) override
+    {
+        return 0.0;
+    }
+    Object Visit(Unary *expr) override
+    {
+        return static_cast<double>(expr->oper().line());
+    }
+    Object Visit(Variable *expr) override
+    {
+        return static_cast<double>(expr->name().line());
+    }
+    Object Visit(Assign *expr) override
+    {
+        return static_cast<double>(expr->name().line());
+    }
+    Object Visit(Logical *expr) override
+    {
+        return Either(Find(expr->left()), expr->oper());
+    }
+    Object Visit(Call *expr) override
+    {
+        return Either(Find(expr->callee()), expr->paren());
+    }
+    Object Visit(Get *expr) override
+    {
+        return Either(Find(expr->object()), expr->name());
+    }
+    Object Visit(Set *expr) override
+    {
+        return Either(Find(expr->object()), expr->name());
+    }
+    Object Visit(This *expr) override
+    {
+        return static_cast<double>(expr->keyword().line());
+    }
+    Object Visit(Super *expr) override
+    {
+        return static_cast<double>(expr->keyword().line());
+    }
+
+    Object Visit(Expression *stmt) override
+    {
+        return static_cast<double>(Find(stmt->expression()));
+    }
+    Object Visit(Print *stmt) override
+    {
+        return static_cast<double>(Find(stmt->expression()));
+    }
+    Object Visit(Var *stmt) override
+    {
+        return static_cast<double>(stmt->name().line());
+    }
+    Object Visit(Block *stmt) override
+    {
+        for (const StmtUniquePtr &statement : stmt->statements())
+        {
+            size_t line = statement != nullptr ? Find(statement.get()) : 0;
+            if (line != 0)
+            {
+                return static_cast<double>(line);
+            }
+        }
+        return 0.0;
+    }
+    Object Visit(If *stmt) override
+    {
+        return static_cast<double>(Find(stmt->condition()));
+    }
+    Object Visit(While *stmt) override
+    {
+        return static_cast<double>(Find(stmt->condition()));
+    }
+    Object Visit(Function *stmt) override
+    {
+        return static_cast<double>(stmt->name().line());
+    }
+    Object Visit(Return *stmt) override
+    {
+        return static_cast<double>(stmt->keyword().line());
+    }
+    Object Visit(Class *stmt) override
+    {
+        return static_cast<double>(stmt->name().line());
+    }
+    Object Visit(Import *stmt) override
+    {
+        return static_cast<double>(stmt->keyword().line());
+    }
+
+  private:
+    static Object Either(size_t line, const Token &fallback)
+    {
+        return static_cast<double>(line != 0 ? line : fallback.line());
+    }
+};
+} // namespace
+
+size_t LineOf(Expr *expr)
+{
+    LineFinder finder;
+    return finder.Find(expr);
+}
+
+size_t LineOf(Stmt *stmt)
+{
+    LineFinder finder;
+    return finder.Find(stmt);
+}
+} // namespace lox
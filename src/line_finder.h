@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.h"
+
+namespace lox
+{
+// The line a node starts on, that of its leftmost token; 0 for a node that
+// holds no token at all (a literal, a desugared block).
+size_t LineOf(expr::Expr *expr);
+size_t LineOf(stmt::Stmt *stmt);
+} // namespace lox
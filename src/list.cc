@@ -0,0 +1,483 @@
+#include "list.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <sstream>
+#include <typeinfo>
+
+#include "callable.h"
+#include "array.h"
+#include "environment.h"
+#include "error.h"
+#include "interpreter.h"
+#include "profiler.h"
+#include "pure_function.h"
+#include "thread_pool.h"
+
+namespace lox
+{
+namespace
+{
+// below this a list is sorted on the calling thread
+constexpr size_t kParallelSortMin = 1 << 15;
+// sorted runs per worker, so one slow run does not hold up the merges
+constexpr size_t kRunsPerWorker = 4;
+// below this a callback is called on the calling thread
+constexpr size_t kParallelCallMin = 1 << 12;
+
+// Sorts runs of `values` in parallel, then merges neighbouring runs in rounds
+// between `values` and a buffer, each round's merges in parallel.
+template <typename T, typename Less>
+void ParallelSort(std::vector<T> &values, Less less)
+{
+    ThreadPool &pool = ThreadPool::Shared();
+    size_t size = values.size();
+    if (size < kParallelSortMin || pool.size() < 2)
+    {
+        std::sort(values.begin(), values.end(), less);
+        return;
+    }
+
+    size_t runs = pool.size() * kRunsPerWorker;
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= runs; i++)
+    {
+        bounds.push_back(size * i / runs);
+    }
+    {
+        TaskGroup group(pool);
+        for (size_t i = 0; i < runs; i++)
+        {
+            group.Run([&values, &less, begin = bounds[i], end = bounds[i + 1]] {
+                std::sort(values.begin() + begin, values.begin() + end, less);
+            });
+        }
+        group.Wait();
+    }
+
+    std::vector<T> buffer(size);
+    std::vector<T> *from = &values;
+    std::vector<T> *to = &buffer;
+    while (bounds.size() > 2)
+    {
+        std::vector<size_t> merged{0};
+        TaskGroup group(pool);
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2)
+        {
+            size_t begin = bounds[i];
+            size_t middle = bounds[i + 1];
+            // an odd run out is moved across unchanged
+            size_t end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+            group.Run([from, to, &less, begin, middle, end] {
+                std::merge(
+                    std::make_move_iterator(from->begin() + begin), std::make_move_iterator(from->begin() + middle),
+                    std::make_move_iterator(from->begin() + middle), std::make_move_iterator(from->begin() + end),
+                    to->begin() + begin, less
+                );
+            });
+            merged.push_back(end);
+        }
+        group.Wait();
+        bounds = std::move(merged);
+        std::swap(from, to);
+    }
+    if (from != &values)
+    {
+        values = std::move(buffer);
+    }
+}
+
+List *ListArgument(const std::vector<Object> &arguments, const char *function)
+{
+    if (!IsObjectInstance<ListPtr>(arguments.at(0)))
+    {
+        throw NativeError(std::string(function) + "() expects a list.");
+    }
+    return std::get<ListPtr>(arguments.at(0));
+}
+
+Callable *FunctionArgument(const std::vector<Object> &arguments, size_t arity, const char *function)
+{
+    if (!IsObjectInstance<CallablePtr>(arguments.at(1)) || std::get<CallablePtr>(arguments.at(1))->arity() != arity)
+    {
+        throw NativeError(
+            std::string(function) + "() expects a function taking " + std::to_string(arity) +
+            (arity == 1 ? " argument." : " arguments.")
+        );
+    }
+    return std::get<CallablePtr>(arguments.at(1));
+}
+
+// `function` as it can be called on other threads over `values`, or nullptr
+// if the calling thread has to make the calls itself: too few values, a value
+// that is not plain or a function that is not pure. Profiling and counting
+// interpreters always call on their own thread, their hooks see only their
+// own calls.
+std::unique_ptr<PureFunction> ParallelFunction(
+    Interpreter *interpreter, Callable *function, const std::vector<Object> &values
+)
+{
+    if (values.size() < kParallelCallMin || ThreadPool::Shared().size() < 2 || Profiler::enabled() ||
+        typeid(*interpreter) != typeid(Interpreter) ||
+        !std::all_of(values.begin(), values.end(), PureFunction::IsPlain))
+    {
+        return nullptr;
+    }
+    return PureFunction::Find(function, interpreter);
+}
+
+// chunks to split the values into, a few per worker so one slow chunk does
+// not hold up the rest
+size_t CallChunks()
+{
+    return ThreadPool::Shared().size() * kRunsPerWorker;
+}
+
+// Runs `chunks` chunks of `size` values on ThreadPool::Shared(), each on a
+// fresh Interpreter of its own: `chunk(worker, callee, index, begin, end)`
+// calls `callee`, the function as installed in `worker`, for the values in
+// [begin, end) and returns false on a result it cannot use. False if any
+// chunk failed. A failed chunk reports nothing: since the function is pure,
+// the caller can run it again on its own thread, where whatever goes wrong is
+// reported as it would have been.
+template <typename Chunk>
+bool CallInParallel(Interpreter *interpreter, const PureFunction &function, size_t size, size_t chunks, Chunk chunk)
+{
+    std::atomic<bool> failed{false};
+    TaskGroup group(ThreadPool::Shared());
+    for (size_t i = 0; i < chunks; i++)
+    {
+        group.Run([&, i, begin = size * i / chunks, end = size * (i + 1) / chunks] {
+            if (failed.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            std::ostringstream discarded;
+            ErrorState errors(&discarded, nullptr);
+            ErrorStateScope scope(&errors);
+            bool done = false;
+            try
+            {
+                Interpreter worker;
+                worker.ShareInterrupt(interpreter);
+                Callable *callee = function.Install(&worker);
+                OperandScope operands(&worker);
+                operands.Push(callee);
+                done = chunk(&worker, callee, i, begin, end);
+            }
+            catch (...)
+            {
+            }
+            if (!done || errors.had_error || errors.had_runtime_error)
+            {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+    group.Wait();
+    return !failed.load(std::memory_order_relaxed);
+}
+
+Object ListFunc(Interpreter *interpreter, const std::vector<Object> &)
+{
+    return interpreter->heap().Allocate<List>();
+}
+
+Object LenFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    return static_cast<double>(ListArgument(arguments, "listLen")->values().size());
+}
+
+Object GetFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    std::vector<Object> &values = ListArgument(arguments, "listGet")->values();
+    return values[IndexArgument(arguments, 1, values.size(), "listGet")];
+}
+
+Object SetFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listSet");
+    list->values()[IndexArgument(arguments, 1, list->values().size(), "listSet")] = arguments.at(2);
+    interpreter->heap().WriteBarrier(list, arguments.at(2));
+    return arguments.at(2);
+}
+
+Object PushFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listPush");
+    list->values().push_back(arguments.at(1));
+    interpreter->heap().WriteBarrier(list, arguments.at(1));
+    return list;
+}
+
+Object PopFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    std::vector<Object> &values = ListArgument(arguments, "listPop")->values();
+    if (values.empty())
+    {
+        throw NativeError("listPop() from an empty list.");
+    }
+    Object value = std::move(values.back());
+    values.pop_back();
+    return value;
+}
+
+Object SortFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listSort");
+    std::vector<Object> &values = list->values();
+    if (std::all_of(values.begin(), values.end(), IsObjectInstance<double>))
+    {
+        // sorted as plain doubles, half the size of an Object and no variant checks
+        std::vector<double> numbers;
+        numbers.reserve(values.size());
+        for (const Object &value : values)
+        {
+            numbers.push_back(std::get<double>(value));
+        }
+        ParallelSort(numbers, [](double a, double b) { return a < b || (std::isnan(b) && !std::isnan(a)); });
+        for (size_t i = 0; i < numbers.size(); i++)
+        {
+            values[i] = numbers[i];
+        }
+    }
+    else if (std::all_of(values.begin(), values.end(), IsObjectInstance<std::string>))
+    {
+        ParallelSort(values, [](const Object &a, const Object &b) {
+            return *std::get_if<std::string>(&a) < *std::get_if<std::string>(&b);
+        });
+    }
+    else
+    {
+        throw NativeError("listSort() expects only numbers or only strings; use listSortBy() for other values.");
+    }
+    return list;
+}
+
+Object SortByFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listSortBy");
+    Callable *less = FunctionArgument(arguments, 2, "listSortBy");
+
+    // the comparison may change the list, so a copy is sorted, with its
+    // elements rooted in case the list drops them, and then put in its place
+    std::vector<Object> values = list->values();
+    OperandScope operands(interpreter);
+    for (const Object &value : values)
+    {
+        operands.Push(value);
+    }
+    std::vector<Object> pair(2);
+    std::stable_sort(values.begin(), values.end(), [&](const Object &a, const Object &b) {
+        pair[0] = a;
+        pair[1] = b;
+        return Interpreter::IsTruthy(less->Call(interpreter, pair));
+    });
+    list->values() = std::move(values);
+    return list;
+}
+
+Object TransformFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listTransform");
+    Callable *function = FunctionArgument(arguments, 1, "listTransform");
+
+    const std::vector<Object> &values = list->values();
+    if (std::unique_ptr<PureFunction> pure = ParallelFunction(interpreter, function, values))
+    {
+        std::vector<Object> results(values.size());
+        auto chunk = [&](Interpreter *worker, Callable *callee, size_t, size_t begin, size_t end) {
+            std::vector<Object> argument(1);
+            for (size_t i = begin; i < end; i++)
+            {
+                argument[0] = values[i];
+                results[i] = callee->Call(worker, argument);
+                if (!PureFunction::IsPlain(results[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (CallInParallel(interpreter, *pure, values.size(), CallChunks(), chunk))
+        {
+            return interpreter->heap().Allocate<List>(std::move(results));
+        }
+    }
+
+    List *result = interpreter->heap().Allocate<List>();
+    OperandScope operands(interpreter);
+    operands.Push(result);
+    std::vector<Object> argument(1);
+    // by index, since the callback may change the list
+    for (size_t i = 0; i < list->values().size(); i++)
+    {
+        argument[0] = list->values()[i];
+        result->values().push_back(function->Call(interpreter, argument));
+        interpreter->heap().WriteBarrier(result, result->values().back());
+    }
+    return result;
+}
+
+Object FilterFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listFilter");
+    Callable *predicate = FunctionArgument(arguments, 1, "listFilter");
+
+    const std::vector<Object> &values = list->values();
+    if (std::unique_ptr<PureFunction> pure = ParallelFunction(interpreter, predicate, values))
+    {
+        std::vector<char> keep(values.size());
+        auto chunk = [&](Interpreter *worker, Callable *callee, size_t, size_t begin, size_t end) {
+            std::vector<Object> argument(1);
+            for (size_t i = begin; i < end; i++)
+            {
+                argument[0] = values[i];
+                keep[i] = Interpreter::IsTruthy(callee->Call(worker, argument));
+            }
+            return true;
+        };
+        if (CallInParallel(interpreter, *pure, values.size(), CallChunks(), chunk))
+        {
+            std::vector<Object> kept;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                if (keep[i])
+                {
+                    kept.push_back(values[i]);
+                }
+            }
+            return interpreter->heap().Allocate<List>(std::move(kept));
+        }
+    }
+
+    List *result = interpreter->heap().Allocate<List>();
+    OperandScope operands(interpreter);
+    operands.Push(result);
+    std::vector<Object> argument(1);
+    for (size_t i = 0; i < list->values().size(); i++)
+    {
+        argument[0] = list->values()[i];
+        if (Interpreter::IsTruthy(predicate->Call(interpreter, argument)))
+        {
+            result->values().push_back(argument[0]);
+            interpreter->heap().WriteBarrier(result, argument[0]);
+        }
+    }
+    return result;
+}
+
+Object ReduceFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listReduce");
+    Callable *function = FunctionArgument(arguments, 2, "listReduce");
+
+    std::vector<Object> pair(2);
+    pair[0] = arguments.at(2);
+    for (size_t i = 0; i < list->values().size(); i++)
+    {
+        pair[1] = list->values()[i];
+        // the accumulator is a parameter of the callback while it runs, and
+        // only ever held here in between
+        pair[0] = function->Call(interpreter, pair);
+    }
+    return pair[0];
+}
+
+Object ParallelReduceFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    List *list = ListArgument(arguments, "listParallelReduce");
+    Callable *function = FunctionArgument(arguments, 2, "listParallelReduce");
+
+    // each chunk is folded from its own first element, then the chunk results
+    // from the initial value, in order; for an associative function that is
+    // the fold of the whole list
+    const std::vector<Object> &values = list->values();
+    if (std::unique_ptr<PureFunction> pure = ParallelFunction(interpreter, function, values))
+    {
+        std::vector<Object> partials(CallChunks());
+        auto chunk = [&](Interpreter *worker, Callable *callee, size_t index, size_t begin, size_t end) {
+            std::vector<Object> pair(2);
+            pair[0] = values[begin];
+            for (size_t i = begin + 1; i < end; i++)
+            {
+                pair[1] = values[i];
+                pair[0] = callee->Call(worker, pair);
+                if (!PureFunction::IsPlain(pair[0]))
+                {
+                    return false;
+                }
+            }
+            partials[index] = std::move(pair[0]);
+            return true;
+        };
+        if (CallInParallel(interpreter, *pure, values.size(), partials.size(), chunk))
+        {
+            std::vector<Object> pair(2);
+            pair[0] = arguments.at(2);
+            for (Object &partial : partials)
+            {
+                pair[1] = std::move(partial);
+                pair[0] = function->Call(interpreter, pair);
+            }
+            return pair[0];
+        }
+    }
+    return ReduceFunc(interpreter, arguments);
+}
+} // namespace
+
+std::string List::ToString() const
+{
+    thread_local std::vector<const List *> printing;
+    if (std::find(printing.begin(), printing.end(), this) != printing.end())
+    {
+        return "[...]";
+    }
+    printing.push_back(this);
+    std::string str = "[";
+    for (size_t i = 0; i < values_.size(); i++)
+    {
+        if (i > 0)
+        {
+            str += ", ";
+        }
+        AppendObject(str, values_[i]);
+    }
+    str += "]";
+    printing.pop_back();
+    return str;
+}
+
+void List::Trace(Heap *heap)
+{
+    for (const Object &value : values_)
+    {
+        heap->Mark(value);
+    }
+}
+
+void DefineListFunctions(Heap *heap, Environment *globals)
+{
+    struct Native
+    {
+        const char *name;
+        Object (*func)(Interpreter *, const std::vector<Object> &);
+        int arity;
+    };
+    static const Native kNatives[] = {
+        {"newList", ListFunc, 0},          {"listLen", LenFunc, 1},
+        {"listGet", GetFunc, 2},           {"listSet", SetFunc, 3},
+        {"listPush", PushFunc, 2},         {"listPop", PopFunc, 1},
+        {"listSort", SortFunc, 1},         {"listSortBy", SortByFunc, 2},
+        {"listTransform", TransformFunc, 2}, {"listFilter", FilterFunc, 2},
+        {"listReduce", ReduceFunc, 3},     {"listParallelReduce", ParallelReduceFunc, 3},
+    };
+    for (const Native &native : kNatives)
+    {
+        globals->Define(native.name, heap->Allocate<BuiltinCallable>(native.name, native.func, native.arity));
+    }
+}
+} // namespace lox
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gc.h"
+#include "object.h"
+
+namespace lox
+{
+class Environment;
+
+// Growable list of any values, stored contiguously.
+class List : public GcObject
+{
+  public:
+    List() = default;
+    explicit List(std::vector<Object> values) : values_(std::move(values)) {}
+
+    std::vector<Object> &values()
+    {
+        return values_;
+    }
+
+    // [1, a, [...]], where [...] is a list already being printed
+    std::string ToString() const;
+
+    void Trace(Heap *heap) override;
+
+    size_t HeapSize() const override
+    {
+        return sizeof(List) + values_.capacity() * sizeof(Object);
+    }
+
+  private:
+    std::vector<Object> values_;
+};
+
+// Defines the list natives in `globals`, named after the type so that a
+// script's own names do not hide them:
+//
+//   newList()                        a new empty list
+//   listLen(l), listGet(l, i), listSet(l, i, value)
+//   listPush(l, value), listPop(l)   at the end; listPush returns l
+//   listSort(l)                      numbers (NaN last) or strings, in place
+//   listSortBy(l, less)              stable, by less(a, b), in place
+//   listTransform(l, fn), listFilter(l, pred)   new lists
+//   listReduce(l, fn, initial)       fn(accumulator, element) from the left
+//   listParallelReduce(l, fn, initial)   the same for an associative fn
+//
+// listSort() of a large list is a parallel merge sort on ThreadPool::Shared().
+// listTransform(), listFilter() and listParallelReduce() of a large list of
+// plain values (nil, booleans, numbers and strings) call a pure callback (see
+// pure_function.h) in chunks on the pool, each chunk on a fresh Interpreter,
+// as long as its results are plain too. Anything else, or anything that goes
+// wrong on a worker, runs on the calling thread one element at a time, which
+// gives the same results as the parallel calls.
+void DefineListFunctions(Heap *heap, Environment *globals);
+} // namespace lox
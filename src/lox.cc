@@ -6,61 +6,201 @@
 #include <string>
 
 #include "ast.h"
+#include "compile_cache.h"
 #include "scanner.h"
 #include "parser.h"
+#include "pipeline.h"
 #include "error.h"
+#include "modules.h"
+#include "output.h"
+#include "profiler.h"
+#include "resolver.h"
+#include "stats.h"
+#include "trace.h"
 //#include "ast_printer.h"
 
 using namespace lox;
 using namespace lox::expr;
 
-Interpreter Lox::interpreter;
+bool Lox::streaming = false;
+bool Lox::pipelined = false;
+size_t Lox::scan_jobs = 1;
 
-void Lox::RunFile(const std::string &path)
+Lox::Lox(std::unique_ptr<Interpreter> interpreter, Output *output, std::ostream &errors)
+    : interpreter_(std::move(interpreter)), output_(output), errors_(&errors, output)
 {
+    interpreter_->set_output(output);
+}
+
+int Lox::RunFile(const std::string &path)
+{
+    ErrorStateScope error_scope(&errors_);
     std::ifstream file(path);
     if (!file.is_open())
     {
-        std::cerr << "can not open file: " + path << std::endl;
+        *errors_.stream << "can not open file: " + path << std::endl;
+        return 66;
     }
 
     std::stringstream buffer;
     buffer << file.rdbuf();
-    std::string code = buffer.str();
-    Run(code);
-    if (had_error)
+    interpreter_->set_script_path(path);
+    if (pipelined)
+    {
+        RunPipeline(interpreter_.get(), std::move(buffer).str());
+    }
+    else if (streaming)
+    {
+        RunStreaming(std::move(buffer).str());
+    }
+    else if (CompileCache::enabled())
     {
-        exit(1);
+        RunCached(buffer.str());
     }
-    if(had_runtime_error)
+    else
     {
-        exit(-1);
+        Run(buffer.str());
     }
+    if (errors_.had_error)
+    {
+        return 1;
+    }
+    if(errors_.had_runtime_error)
+    {
+        return -1;
+    }
+    return 0;
 }
 
 void Lox::RunPrompt()
 {
+    ErrorStateScope error_scope(&errors_);
     std::string line;
     while (true)
     {
-        std::cout << "> ";
+        output_->Write("> ");
+        output_->Flush();
         if (!std::getline(std::cin, line))
         {
             break;
         }
         Run(line);
-        had_error = false;
+        errors_.had_error = false;
     }
 }
 
 void Lox::Run(const std::string &source)
+{
+    ErrorStateScope error_scope(&errors_);
+    Program program = Compile(source);
+    if(errors_.had_error) return;
+    Execute(program);
+}
+
+void Lox::RunCached(const std::string &source)
+{
+    ErrorStateScope error_scope(&errors_);
+    Program program;
+    bool cached;
+    {
+        PhaseScope phase(Stats::Phase::kParse);
+        TraceScope trace_scope("phase", "cache load");
+        cached = CompileCache::Load(source, &program);
+    }
+    if (!cached)
+    {
+        program = Compile(source);
+        if (errors_.had_error) return;
+        CompileCache::Store(source, program);
+    }
+    Execute(program);
+}
+
+Program Lox::Compile(const std::string &source)
 {
     Scanner scanner(source);
-    auto tokens = scanner.ScanTokens();
-    Parser parser(tokens);
+    {
+        PhaseScope phase(Stats::Phase::kScan);
+        TraceScope trace_scope("phase", "scan");
+        scan_jobs > 1 ? scanner.ScanTokensParallel(scan_jobs) : scanner.ScanTokens();
+    }
+    PhaseScope phase(Stats::Phase::kParse);
+    TraceScope trace_scope("phase", "parse");
+    Parser parser(scanner.tokens());
     Program program = parser.Parse();
+    if (!CurrentErrorState().had_error)
+    {
+        Resolver resolver;
+        for (const StmtUniquePtr &statement : program)
+        {
+            resolver.Resolve(statement.get());
+        }
+    }
+    return program;
+}
+
+void Lox::Execute(Program &program)
+{
+    {
+        PhaseScope phase(Stats::Phase::kParse);
+        TraceScope trace_scope("phase", "import");
+        Modules::Prefetch(program, interpreter_->module_directory());
+    }
+    {
+        PhaseScope phase(Stats::Phase::kExecute);
+        TraceScope trace_scope("phase", "interpret");
+        interpreter_->Interpret(program);
+    }
 
-    if(had_error) return;
+    // the profiler's samples point into this program's AST
+    Profiler::Collect();
+    interpreter_->Retain(std::move(program));
+}
+
+void Lox::RunStreaming(std::string source)
+{
+    ErrorStateScope error_scope(&errors_);
+    Scanner scanner(std::move(source));
+    Parser parser(&scanner);
+    Resolver resolver;
+
+    // function declarations stay alive for the callables that point into them;
+    // everything else is freed as soon as it has run
+    Program retained;
+    while (!parser.IsAtEnd())
+    {
+        size_t functions_parsed = parser.functions_parsed();
+        StmtUniquePtr statement;
+        {
+            PhaseScope phase(Stats::Phase::kParse);
+            statement = parser.ParseDeclaration();
+            if (statement != nullptr)
+            {
+                resolver.Resolve(statement.get());
+            }
+        }
 
-    interpreter.Interpret(program);
-}
\ No newline at end of file
+        // after a syntax error keep parsing to report the rest, but run nothing more
+        if (errors_.had_error || errors_.had_runtime_error || statement == nullptr)
+        {
+            continue;
+        }
+
+        {
+            PhaseScope phase(Stats::Phase::kExecute);
+            interpreter_->Interpret(statement.get());
+        }
+
+        if (parser.functions_parsed() != functions_parsed)
+        {
+            retained.push_back(std::move(statement));
+        }
+        else
+        {
+            interpreter_->Discard(std::move(statement));
+        }
+    }
+
+    Profiler::Collect();
+    interpreter_->Retain(std::move(retained));
+}
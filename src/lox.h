@@ -1,17 +1,62 @@
 #pragma once
+#include <iostream>
+#include <memory>
 #include <string>
 
+#include "ast.h"
+#include "error.h"
 #include "interpreter.h"
+#include "output.h"
 
 namespace lox
 {
+// An interpreter together with where its output and errors go. Instances
+// share no state, so separate ones can run on separate threads; each installs
+// its own ErrorState for the duration of a Run* call.
 class Lox
 {
   public:
-    static void RunFile(const std::string &path);
-    static void RunPrompt();
-    static void Run(const std::string &source);
+    explicit Lox(std::unique_ptr<Interpreter> interpreter = std::make_unique<Interpreter>(),
+                 Output *output = &Output::Standard(), std::ostream &errors = std::cerr);
+
+    // 0 on success, 1 after a syntax error, -1 after a runtime error and 66
+    // when the file can not be read
+    int RunFile(const std::string &path);
+    void RunPrompt();
+    void Run(const std::string &source);
+    // Run, with the parsed program taken from / saved to the compile cache
+    void RunCached(const std::string &source);
+    // execute each top-level declaration as soon as it is parsed
+    void RunStreaming(std::string source);
+
+    Interpreter *interpreter()
+    {
+        return interpreter_.get();
+    }
+
+    const ErrorState &errors() const
+    {
+        return errors_;
+    }
+
+    // scans, parses and, when that reported no error, resolves `source`;
+    // errors go to the current ErrorState
+    static Program Compile(const std::string &source);
+
+  private:
+    void Execute(Program &program);
+
   public:
-    static Interpreter interpreter;
+    // process-wide, set before anything runs
+    static bool streaming;
+    // streaming with scanning and parsing on their own threads, see pipeline.h
+    static bool pipelined;
+    // threads used to scan a whole file at once, see Scanner::ScanTokensParallel
+    static size_t scan_jobs;
+
+  private:
+    std::unique_ptr<Interpreter> interpreter_;
+    Output *output_;
+    ErrorState errors_;
 };
-} // namespace lox
\ No newline at end of file
+} // namespace lox
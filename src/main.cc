@@ -1,21 +1,388 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <csignal>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "compile_cache.h"
+#include "counting_interpreter.h"
+#include "gc.h"
+#include "jobs.h"
 #include "lox.h"
+#include "output.h"
+#include "profiler.h"
+#include "serve.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 using namespace lox;
 
+namespace
+{
+constexpr const char *kUsage = "Usage: lox-cpp [--profile[=file]] [--count[=top_n]] [--stats | --stats-json]\n"
+                         "               [--trace-out=file [--trace-calls]]\n"
+                         "               [--flush=line|full|never-until-exit] [--stream | --pipeline]\n"
+                         "               [--scan-jobs[=N]] [--threads=N] [--cache[=dir]]\n"
+                         "               [--gc-nursery=bytes] [--gc-min-heap=bytes] [--gc-growth=factor]\n"
+                         "               [--snapshot=file | --make-snapshot=file] [script]\n"
+                         "       lox-cpp --jobs=N [--snapshot=file] [options] script...\n"
+                         "       lox-cpp --serve=socket [--serve-workers=N] [--serve-timeout=ms]\n"
+                         "               [--serve-client-timeout=ms] [--serve-cache=N]\n"
+                         "               [--serve-max-request=bytes] [--snapshot=file] [options]\n"
+                         "       lox-cpp --connect=socket (script | --script-id=id)";
+
+// more would only exhaust the process
+constexpr size_t kMaxThreads = 1024;
+constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+bool StartsWith(const std::string &str, const std::string &prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// what follows the '=' of a --flag=value argument
+std::string_view FlagValue(const std::string &arg)
+{
+    return std::string_view(arg).substr(arg.find('=') + 1);
+}
+
+// Parses all of `text` as a number in [min, max] into `value`; returns false,
+// leaving `value` alone, for anything else.
+template <typename T>
+bool ParseNumber(std::string_view text, T min, T max, T *value)
+{
+    T parsed{};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    // written so that NaN fails too
+    if (error != std::errc() || end != text.data() + text.size() || !(parsed >= min && parsed <= max))
+    {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+int UsageError()
+{
+    std::cout << kUsage << std::endl;
+    return 64;
+}
+} // namespace
+
 int main(int argc, char** argv)
 {
-    if(argc > 2)
+    // print goes through Output; nothing relies on iostreams sharing stdio's buffer
+    std::ios::sync_with_stdio(false);
+#ifdef SIGPIPE
+    // a closed pipe shows up as a failed write, after which output is discarded
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    std::vector<std::string> scripts;
+    size_t jobs = 0;
+    ServerOptions server;
+    std::string connect_path;
+    std::string script_id;
+    std::string profile_path;
+    size_t count_top_n = 0;
+    bool stats_json = false;
+    std::string trace_path;
+    bool trace_calls = false;
+    std::string snapshot_path;
+    std::string make_snapshot_path;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--profile")
+        {
+            profile_path = "lox.folded";
+        }
+        else if (StartsWith(arg, "--profile="))
+        {
+            profile_path = arg.substr(std::string("--profile=").size());
+        }
+        else if (arg == "--count")
+        {
+            count_top_n = 20;
+        }
+        else if (StartsWith(arg, "--count="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kUnlimited, &count_top_n))
+            {
+                return UsageError();
+            }
+        }
+        else if (arg == "--stats" || arg == "--stats-json")
+        {
+            Stats::Enable();
+            stats_json = arg == "--stats-json";
+        }
+        else if (StartsWith(arg, "--trace-out="))
+        {
+            trace_path = arg.substr(std::string("--trace-out=").size());
+        }
+        else if (arg == "--trace-calls")
+        {
+            trace_calls = true;
+        }
+        else if (arg == "--flush=line")
+        {
+            Output::Standard().set_policy(Output::FlushPolicy::kLine);
+        }
+        else if (arg == "--flush=full")
+        {
+            Output::Standard().set_policy(Output::FlushPolicy::kFull);
+        }
+        else if (arg == "--flush=never-until-exit")
+        {
+            Output::Standard().set_policy(Output::FlushPolicy::kNeverUntilExit);
+        }
+        else if (arg == "--stream")
+        {
+            Lox::streaming = true;
+        }
+        else if (arg == "--pipeline")
+        {
+            Lox::pipelined = true;
+        }
+        else if (arg == "--cache")
+        {
+            CompileCache::Enable(".loxcache");
+        }
+        else if (StartsWith(arg, "--cache="))
+        {
+            CompileCache::Enable(arg.substr(std::string("--cache=").size()));
+        }
+        else if (StartsWith(arg, "--snapshot="))
+        {
+            snapshot_path = arg.substr(std::string("--snapshot=").size());
+        }
+        else if (StartsWith(arg, "--make-snapshot="))
+        {
+            make_snapshot_path = arg.substr(std::string("--make-snapshot=").size());
+        }
+        else if (arg == "--scan-jobs")
+        {
+            Lox::scan_jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        else if (StartsWith(arg, "--scan-jobs="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kMaxThreads, &Lox::scan_jobs))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--threads="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{0}, kMaxThreads, &ThreadPool::shared_threads))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--jobs="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kMaxThreads, &jobs))
+            {
+                return UsageError();
+            }
+        }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            if (!ParseNumber(std::string_view(argv[++i]), size_t{1}, kMaxThreads, &jobs))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--serve="))
+        {
+            server.socket_path = arg.substr(std::string("--serve=").size());
+        }
+        else if (arg == "--serve" && i + 1 < argc)
+        {
+            server.socket_path = argv[++i];
+        }
+        else if (StartsWith(arg, "--serve-workers="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{0}, kMaxThreads, &server.workers))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--serve-timeout="))
+        {
+            uint64_t timeout_ms = 0;
+            if (!ParseNumber(FlagValue(arg), uint64_t{0}, uint64_t{1} << 40, &timeout_ms))
+            {
+                return UsageError();
+            }
+            server.timeout = std::chrono::milliseconds(timeout_ms);
+        }
+        else if (StartsWith(arg, "--serve-client-timeout="))
+        {
+            uint64_t timeout_ms = 0;
+            if (!ParseNumber(FlagValue(arg), uint64_t{1}, uint64_t{1} << 40, &timeout_ms))
+            {
+                return UsageError();
+            }
+            server.client_timeout = std::chrono::milliseconds(timeout_ms);
+        }
+        else if (StartsWith(arg, "--serve-cache="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kUnlimited, &server.cache_size))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--serve-max-request="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kUnlimited, &server.max_request))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--connect="))
+        {
+            connect_path = arg.substr(std::string("--connect=").size());
+        }
+        else if (StartsWith(arg, "--script-id="))
+        {
+            script_id = arg.substr(std::string("--script-id=").size());
+        }
+        else if (StartsWith(arg, "--gc-nursery="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{1}, kUnlimited, &Heap::tuning.nursery_bytes))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--gc-min-heap="))
+        {
+            if (!ParseNumber(FlagValue(arg), size_t{0}, kUnlimited, &Heap::tuning.min_heap_bytes))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--gc-growth="))
+        {
+            if (!ParseNumber(FlagValue(arg), 1.0, std::numeric_limits<double>::max(), &Heap::tuning.growth_factor))
+            {
+                return UsageError();
+            }
+        }
+        else if (StartsWith(arg, "--"))
+        {
+            return UsageError();
+        }
+        else
+        {
+            scripts.push_back(arg);
+        }
+    }
+
+    bool serving = !server.socket_path.empty();
+    bool usage_error;
+    if (!connect_path.empty())
+    {
+        usage_error = jobs > 0 || serving || scripts.size() != (script_id.empty() ? 1u : 0u) ||
+                      !make_snapshot_path.empty();
+    }
+    else if (serving)
+    {
+        usage_error = jobs > 0 || !scripts.empty() || !script_id.empty();
+    }
+    else
+    {
+        // a snapshot is made of what a script defines, so there has to be one
+        usage_error = !script_id.empty() || (jobs > 0 ? scripts.empty() : scripts.size() > 1) ||
+                      (!make_snapshot_path.empty() && scripts.empty());
+    }
+    // batch jobs and served requests run side by side: the profiler and the
+    // counters are per process
+    bool concurrent = jobs > 0 || serving;
+    if (usage_error || (concurrent && (!profile_path.empty() || count_top_n > 0 || !make_snapshot_path.empty())))
     {
-        std::cout << "Usage: lox-cpp [script]" << std::endl;
+        return UsageError();
     }
-    else if(argc == 2)
+
+    if (!connect_path.empty())
+    {
+        int status = RunClient(connect_path, script_id.empty() ? scripts.front() : "", script_id);
+        Output::Standard().Flush();
+        return status;
+    }
+
+    if (!profile_path.empty() && !Profiler::Start(profile_path))
+    {
+        return 64;
+    }
+
+    if (!trace_path.empty())
+    {
+        Trace::Start(trace_path, trace_calls);
+    }
+
+    if (concurrent)
+    {
+        server.snapshot_path = snapshot_path;
+        int status = jobs > 0 ? RunJobs(scripts, jobs, snapshot_path) : RunServer(server);
+        Output::Standard().Flush();
+        Trace::Stop();
+        if (Stats::enabled())
+        {
+            stats_json ? Stats::ReportJson(std::cerr) : Stats::Report(std::cerr);
+        }
+        return status;
+    }
+
+    CountingInterpreter *counting_interpreter = nullptr;
+    std::unique_ptr<Interpreter> interpreter = std::make_unique<Interpreter>();
+    if (count_top_n > 0)
+    {
+        auto counting = std::make_unique<CountingInterpreter>();
+        counting_interpreter = counting.get();
+        interpreter = std::move(counting);
+    }
+    Lox lox(std::move(interpreter));
+
+    if (!snapshot_path.empty() && !Snapshot::Restore(lox.interpreter(), snapshot_path))
+    {
+        std::cerr << "can not load snapshot: " + snapshot_path << std::endl;
+        return 66;
+    }
+
+    int status = 0;
+    if (!scripts.empty())
     {
-        Lox::RunFile(argv[1]);
+        status = lox.RunFile(scripts.front());
+        if (status == 0 && !make_snapshot_path.empty() && !Snapshot::Save(lox.interpreter(), make_snapshot_path))
+        {
+            std::cerr << "can not write snapshot: " + make_snapshot_path << std::endl;
+            status = 74;
+        }
     }
     else 
     {
-        Lox::RunPrompt();
+        lox.RunPrompt();
+    }
+
+    Output::Standard().Flush();
+    Profiler::Stop();
+    Trace::Stop();
+    if (counting_interpreter != nullptr)
+    {
+        counting_interpreter->Report(count_top_n);
+    }
+    if (Stats::enabled())
+    {
+        stats_json ? Stats::ReportJson(std::cerr) : Stats::Report(std::cerr);
     }
-}
\ No newline at end of file
+    return status;
+}
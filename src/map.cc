@@ -0,0 +1,375 @@
+#include "map.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "callable.h"
+#include "cpu.h"
+#include "environment.h"
+#include "error.h"
+#include "interpreter.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LOX_MAP_SSE2 1
+#endif
+
+namespace lox
+{
+namespace
+{
+// full slots hold h2 in [0, 127]; the other states have the sign bit set
+constexpr int8_t kEmpty = -128;
+constexpr int8_t kDeleted = -2;
+constexpr size_t kNotFound = SIZE_MAX;
+constexpr size_t kMinCapacity = Map::kGroupWidth;
+
+// bit i describes slot i of the group. SSE2 is part of x86-64, so unlike the
+// scanner and array kernels this needs no runtime dispatch.
+class Group
+{
+  public:
+    explicit Group(const int8_t *control)
+    {
+#ifdef LOX_MAP_SSE2
+        control_ = _mm_loadu_si128(reinterpret_cast<const __m128i *>(control));
+#else
+        control_ = control;
+#endif
+    }
+
+    uint32_t Match(int8_t h2) const
+    {
+#ifdef LOX_MAP_SSE2
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(control_, _mm_set1_epi8(h2))));
+#else
+        return MatchScalar([h2](int8_t control) { return control == h2; });
+#endif
+    }
+
+    uint32_t MatchEmpty() const
+    {
+        return Match(kEmpty);
+    }
+
+    uint32_t MatchEmptyOrDeleted() const
+    {
+#ifdef LOX_MAP_SSE2
+        return static_cast<uint32_t>(_mm_movemask_epi8(control_));
+#else
+        return MatchScalar([](int8_t control) { return control < 0; });
+#endif
+    }
+
+  private:
+#ifdef LOX_MAP_SSE2
+    __m128i control_;
+#else
+    template <typename Predicate>
+    uint32_t MatchScalar(Predicate predicate) const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < Map::kGroupWidth; i++)
+        {
+            mask |= static_cast<uint32_t>(predicate(control_[i])) << i;
+        }
+        return mask;
+    }
+
+    const int8_t *control_;
+#endif
+};
+
+int8_t H2(uint64_t hash)
+{
+    return static_cast<int8_t>(hash & 0x7F);
+}
+
+// the final mix of MurmurHash3, so the low bits (h2) and the high bits (the
+// first group) both depend on every input bit
+uint64_t Mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+} // namespace
+
+bool Map::IsValidKey(const Object &key)
+{
+    return IsObjectInstance<std::string>(key) || (IsObjectInstance<double>(key) && !std::isnan(std::get<double>(key)));
+}
+
+uint64_t Map::Hash(const Object &key)
+{
+    if (IsObjectInstance<std::string>(key))
+    {
+        return Mix(std::hash<std::string>{}(std::get<std::string>(key)));
+    }
+    // -0 and 0 are the same key
+    double number = std::get<double>(key) + 0.0;
+    uint64_t bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    return Mix(~bits);
+}
+
+bool Map::KeyEquals(const Object &a, const Object &b)
+{
+    if (IsObjectInstance<double>(a))
+    {
+        return IsObjectInstance<double>(b) && std::get<double>(a) == std::get<double>(b);
+    }
+    return IsObjectInstance<std::string>(b) && std::get<std::string>(a) == std::get<std::string>(b);
+}
+
+size_t Map::FindSlot(const Object &key, uint64_t hash) const
+{
+    if (capacity_ == 0)
+    {
+        return kNotFound;
+    }
+    size_t group_mask = capacity_ / kGroupWidth - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t step = 1;; step++)
+    {
+        size_t base = group * kGroupWidth;
+        Group controls(control_.get() + base);
+        for (uint32_t mask = controls.Match(H2(hash)); mask != 0; mask &= mask - 1)
+        {
+            size_t slot = base + CountTrailingZeros(mask);
+            if (slots_[slot].hash == hash && KeyEquals(slots_[slot].key, key))
+            {
+                return slot;
+            }
+        }
+        if (controls.MatchEmpty() != 0)
+        {
+            return kNotFound;
+        }
+        // triangular steps visit every group of a power-of-two table
+        group = (group + step) & group_mask;
+    }
+}
+
+size_t Map::FindInsertSlot(uint64_t hash) const
+{
+    size_t group_mask = capacity_ / kGroupWidth - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t step = 1;; step++)
+    {
+        uint32_t mask = Group(control_.get() + group * kGroupWidth).MatchEmptyOrDeleted();
+        if (mask != 0)
+        {
+            return group * kGroupWidth + CountTrailingZeros(mask);
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+Object *Map::Find(const Object &key)
+{
+    size_t slot = FindSlot(key, Hash(key));
+    return slot != kNotFound ? &slots_[slot].value : nullptr;
+}
+
+void Map::Insert(const Object &key, Object value)
+{
+    uint64_t hash = Hash(key);
+    size_t slot = FindSlot(key, hash);
+    if (slot != kNotFound)
+    {
+        slots_[slot].value = std::move(value);
+        return;
+    }
+
+    if (growth_left_ == 0)
+    {
+        // mostly deleted slots: rebuild at the same size instead of growing
+        Resize(capacity_ == 0 ? kMinCapacity : size_ * 16 < capacity_ * 7 ? capacity_ : capacity_ * 2);
+    }
+    slot = FindInsertSlot(hash);
+    if (control_[slot] == kEmpty)
+    {
+        growth_left_--;
+    }
+    control_[slot] = H2(hash);
+    slots_[slot].key = key;
+    slots_[slot].value = std::move(value);
+    slots_[slot].hash = hash;
+    size_++;
+    version_++;
+}
+
+bool Map::Erase(const Object &key)
+{
+    size_t slot = FindSlot(key, Hash(key));
+    if (slot == kNotFound)
+    {
+        return false;
+    }
+    slots_[slot].key = nullptr;
+    slots_[slot].value = nullptr;
+    // a probe only passes a group that has no empty slot, so if this group
+    // has one no probe can depend on the slot staying occupied
+    if (Group(control_.get() + slot / kGroupWidth * kGroupWidth).MatchEmpty() != 0)
+    {
+        control_[slot] = kEmpty;
+        growth_left_++;
+    }
+    else
+    {
+        control_[slot] = kDeleted;
+    }
+    size_--;
+    version_++;
+    return true;
+}
+
+void Map::Resize(size_t capacity)
+{
+    std::unique_ptr<int8_t[]> old_control = std::move(control_);
+    std::unique_ptr<Slot[]> old_slots = std::move(slots_);
+    size_t old_capacity = capacity_;
+
+    control_.reset(new int8_t[capacity]);
+    std::memset(control_.get(), kEmpty, capacity);
+    slots_.reset(new Slot[capacity]);
+    capacity_ = capacity;
+    growth_left_ = capacity / 8 * 7 - size_;
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_control[i] >= 0)
+        {
+            size_t slot = FindInsertSlot(old_slots[i].hash);
+            control_[slot] = H2(old_slots[i].hash);
+            slots_[slot] = std::move(old_slots[i]);
+        }
+    }
+}
+
+std::string Map::ToString() const
+{
+    return "<map>";
+}
+
+void Map::Trace(Heap *heap)
+{
+    for (size_t slot = 0; slot < capacity_; slot++)
+    {
+        if (full(slot))
+        {
+            heap->Mark(slots_[slot].value);
+        }
+    }
+}
+
+size_t Map::HeapSize() const
+{
+    return sizeof(Map) + capacity_ * (sizeof(Slot) + sizeof(int8_t));
+}
+
+namespace
+{
+Map *MapArgument(const std::vector<Object> &arguments, const char *function)
+{
+    if (!IsObjectInstance<MapPtr>(arguments.at(0)))
+    {
+        throw NativeError(std::string(function) + "() expects a map.");
+    }
+    return std::get<MapPtr>(arguments.at(0));
+}
+
+Object MapFunc(Interpreter *interpreter, const std::vector<Object> &)
+{
+    return interpreter->heap().Allocate<Map>();
+}
+
+Object LenFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    return static_cast<double>(MapArgument(arguments, "mapLen")->size());
+}
+
+Object GetFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    Map *map = MapArgument(arguments, "mapGet");
+    Object *value = map->Find(MapKeyArgument(arguments, "mapGet"));
+    return value != nullptr ? *value : nullptr;
+}
+
+Object SetFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    Map *map = MapArgument(arguments, "mapSet");
+    map->Insert(MapKeyArgument(arguments, "mapSet"), arguments.at(2));
+    interpreter->heap().WriteBarrier(map, arguments.at(2));
+    return arguments.at(2);
+}
+
+Object HasFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    Map *map = MapArgument(arguments, "mapHas");
+    return map->Find(MapKeyArgument(arguments, "mapHas")) != nullptr;
+}
+
+Object DeleteFunc(Interpreter *, const std::vector<Object> &arguments)
+{
+    Map *map = MapArgument(arguments, "mapDelete");
+    return map->Erase(MapKeyArgument(arguments, "mapDelete"));
+}
+
+Object ForEachFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    Map *map = MapArgument(arguments, "mapForEach");
+    if (!IsObjectInstance<CallablePtr>(arguments.at(1)) || std::get<CallablePtr>(arguments.at(1))->arity() != 2)
+    {
+        throw NativeError("mapForEach() expects a function taking a key and a value.");
+    }
+    CallablePtr function = std::get<CallablePtr>(arguments.at(1));
+
+    uint64_t version = map->version();
+    std::vector<Object> entry(2);
+    for (size_t slot = 0; slot < map->capacity(); slot++)
+    {
+        if (!map->full(slot))
+        {
+            continue;
+        }
+        entry[0] = map->key(slot);
+        entry[1] = map->value(slot);
+        function->Call(interpreter, entry);
+        // replacing values is fine, but added or removed keys move entries
+        if (map->version() != version)
+        {
+            throw NativeError("mapForEach() callback added or deleted a key.");
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+const Object &MapKeyArgument(const std::vector<Object> &arguments, const char *function)
+{
+    if (!Map::IsValidKey(arguments.at(1)))
+    {
+        throw NativeError(std::string(function) + "() expects a string or number key other than NaN.");
+    }
+    return arguments.at(1);
+}
+
+void DefineMapFunctions(Heap *heap, Environment *globals)
+{
+    globals->Define("newMap", heap->Allocate<BuiltinCallable>("newMap", MapFunc, 0));
+    globals->Define("mapLen", heap->Allocate<BuiltinCallable>("mapLen", LenFunc, 1));
+    globals->Define("mapGet", heap->Allocate<BuiltinCallable>("mapGet", GetFunc, 2));
+    globals->Define("mapSet", heap->Allocate<BuiltinCallable>("mapSet", SetFunc, 3));
+    globals->Define("mapHas", heap->Allocate<BuiltinCallable>("mapHas", HasFunc, 2));
+    globals->Define("mapDelete", heap->Allocate<BuiltinCallable>("mapDelete", DeleteFunc, 2));
+    globals->Define("mapForEach", heap->Allocate<BuiltinCallable>("mapForEach", ForEachFunc, 2));
+}
+} // namespace lox
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gc.h"
+#include "object.h"
+
+namespace lox
+{
+class Environment;
+
+// Hash map from strings and numbers to any value, as a Swiss table: open
+// addressing over groups of 16 slots with one control byte per slot. A
+// control byte is either empty, deleted or the low 7 bits of the hash of the
+// key in the slot ("h2"), so one SSE2 compare of a whole group finds the few
+// slots worth comparing keys with. The high bits of the hash pick the first
+// group; the probe then visits groups in triangular order until one has an
+// empty slot.
+//
+// Every slot keeps the full hash of its key, so growing the table never
+// hashes a key again. When an insert finds the table 7/8 full (deleted slots
+// included) it is rebuilt: at twice the size, or at the same size when fewer
+// than 7/16 of the slots hold live keys, which drops the deleted ones so that
+// insert/delete churn does not keep growing it. It never shrinks, and inserts
+// stay amortized O(1) at any size.
+class Map : public GcObject
+{
+  public:
+    static constexpr size_t kGroupWidth = 16;
+
+    Map() = default;
+
+    // strings and numbers other than NaN
+    static bool IsValidKey(const Object &key);
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // changes whenever a key is added or removed, not when a value is replaced
+    uint64_t version() const
+    {
+        return version_;
+    }
+
+    // the value for `key`, or nullptr if there is none
+    Object *Find(const Object &key);
+
+    // inserts or replaces; the caller runs the write barrier
+    void Insert(const Object &key, Object value);
+
+    bool Erase(const Object &key);
+
+    // slots in [0, capacity()); only the full ones hold an entry
+    bool full(size_t slot) const
+    {
+        return control_[slot] >= 0;
+    }
+
+    const Object &key(size_t slot) const
+    {
+        return slots_[slot].key;
+    }
+
+    Object &value(size_t slot)
+    {
+        return slots_[slot].value;
+    }
+
+    std::string ToString() const;
+
+    void Trace(Heap *heap) override;
+    size_t HeapSize() const override;
+
+  private:
+    struct Slot
+    {
+        Object key;
+        Object value;
+        uint64_t hash = 0;
+    };
+
+    static uint64_t Hash(const Object &key);
+    static bool KeyEquals(const Object &a, const Object &b);
+
+    size_t FindSlot(const Object &key, uint64_t hash) const;
+    // the first empty or deleted slot on the probe sequence of `hash`
+    size_t FindInsertSlot(uint64_t hash) const;
+    void Resize(size_t capacity);
+
+  private:
+    std::unique_ptr<int8_t[]> control_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    // inserts left before the table must grow
+    size_t growth_left_ = 0;
+    uint64_t version_ = 0;
+};
+
+// Defines the map natives in `globals`, each named after the type so that
+// they can not be confused with, or hidden by, a script's own names:
+//
+//   newMap()              a new empty map
+//   mapLen(m), mapGet(m, key), mapSet(m, key, value)
+//                         mapGet returns nil for a missing key
+//   mapHas(m, key), mapDelete(m, key)
+//   mapForEach(m, fn)     calls fn(key, value) for every entry, in table order
+void DefineMapFunctions(Heap *heap, Environment *globals);
+
+// the second argument of a map native, checked to be a valid key
+const Object &MapKeyArgument(const std::vector<Object> &arguments, const char *function);
+} // namespace lox
@@ -0,0 +1,50 @@
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+namespace lox
+{
+MappedFile::MappedFile(const std::string &path)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            mapping_ = data;
+            data_ = std::string_view(static_cast<const char *>(data), info.st_size);
+        }
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data_ = buffer_;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mapping_ != nullptr)
+    {
+        munmap(mapping_, data_.size());
+    }
+#endif
+}
+} // namespace lox
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace lox
+{
+// Read-only view of a whole file: memory-mapped where mmap exists, read into
+// a buffer otherwise. data() is empty when the file can't be read.
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    std::string_view data() const
+    {
+        return data_;
+    }
+
+  private:
+#ifndef _WIN32
+    void *mapping_ = nullptr;
+#else
+    std::string buffer_;
+#endif
+    std::string_view data_;
+};
+} // namespace lox
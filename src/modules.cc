@@ -0,0 +1,164 @@
+#include "modules.h"
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "compile_cache.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "thread_pool.h"
+
+namespace lox
+{
+namespace
+{
+struct Entry
+{
+    std::filesystem::file_time_type modified;
+    std::shared_ptr<const Modules::Module> module;
+};
+
+std::mutex registry_mutex;
+std::unordered_map<std::string, Entry> registry;
+
+void Compile(const std::string &source, Modules::Module *module)
+{
+    if (CompileCache::enabled() && CompileCache::Load(source, &module->program))
+    {
+        return;
+    }
+
+    // reported when an import replays them, on the interpreter's thread
+    ErrorCapture capture;
+    Scanner scanner(source);
+    scanner.ScanTokens();
+    Parser parser(scanner.tokens());
+    module->program = parser.Parse();
+    module->errors = capture.Take();
+    if (!module->errors.empty())
+    {
+        return;
+    }
+    Resolver resolver;
+    for (const StmtUniquePtr &statement : module->program)
+    {
+        resolver.Resolve(statement.get());
+    }
+    if (CompileCache::enabled())
+    {
+        CompileCache::Store(source, module->program);
+    }
+}
+
+// the modules `program` imports that are not in `seen` yet
+void AddImports(
+    const Program &program, const std::string &directory, std::unordered_set<std::string> *seen,
+    std::vector<std::string> *paths
+)
+{
+    for (const StmtUniquePtr &statement : program)
+    {
+        if (auto *import = dynamic_cast<stmt::Import *>(statement.get()))
+        {
+            std::string path = Modules::Resolve(directory, import->path());
+            if (seen->insert(path).second)
+            {
+                paths->push_back(std::move(path));
+            }
+        }
+    }
+}
+} // namespace
+
+std::string Modules::Resolve(const std::string &directory, const std::string &name)
+{
+    std::filesystem::path path(name);
+    if (path.is_relative())
+    {
+        path = std::filesystem::path(directory) / path;
+    }
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return (error ? path.lexically_normal() : canonical).string();
+}
+
+void Modules::Prefetch(const Program &program, const std::string &directory)
+{
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> level;
+    AddImports(program, directory, &seen, &level);
+    while (!level.empty())
+    {
+        std::vector<std::shared_ptr<const Module>> loaded(level.size());
+        {
+            TaskGroup group(ThreadPool::Shared());
+            for (size_t i = 0; i < level.size(); i++)
+            {
+                group.Run([&, i] { loaded[i] = Get(level[i]); });
+            }
+            group.Wait();
+        }
+
+        level.clear();
+        for (const std::shared_ptr<const Module> &module : loaded)
+        {
+            if (module != nullptr && module->errors.empty())
+            {
+                AddImports(module->program, module->directory, &seen, &level);
+            }
+        }
+    }
+}
+
+std::shared_ptr<const Modules::Module> Modules::Load(const std::string &path)
+{
+    std::shared_ptr<const Module> module = Get(path);
+    if (module != nullptr && module->errors.empty())
+    {
+        Prefetch(module->program, module->directory);
+    }
+    return module;
+}
+
+std::shared_ptr<const Modules::Module> Modules::Get(const std::string &path)
+{
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = registry.find(path);
+        if (it != registry.end() && it->second.modified == modified)
+        {
+            return it->second.module;
+        }
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return nullptr;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    // compiled outside the lock; two threads may both compile a file that
+    // changed, and the later one wins
+    auto module = std::make_shared<Module>();
+    module->path = path;
+    module->directory = std::filesystem::path(path).parent_path().string();
+    Compile(buffer.str(), module.get());
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry[path] = Entry{modified, module};
+    return module;
+}
+} // namespace lox
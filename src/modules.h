@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+
+namespace lox
+{
+// Modules behind `import "path";`.
+//
+// A module is a file compiled once per process into an immutable program
+// that every interpreter importing it shares; it is compiled again only when
+// the file's modification time changes. An interpreter runs each module once,
+// at its first import, in the global scope. Paths are relative to the
+// importing file, or to the working directory for code without a file.
+//
+// Before a program runs, Prefetch() loads every module its imports reach, a
+// level of the import graph at a time, each level's files scanned and parsed
+// in parallel on the shared thread pool. Only files named by an import are
+// read.
+class Modules
+{
+  public:
+    struct Module
+    {
+        // canonical
+        std::string path;
+        // what its own imports are relative to
+        std::string directory;
+        Program program;
+        // syntax errors, replayed by every import of it; the program is only
+        // resolved and run when there are none
+        std::vector<ErrorRecord> errors;
+    };
+
+    // the canonical path `name` refers to when imported from `directory`
+    static std::string Resolve(const std::string &directory, const std::string &name);
+
+    static void Prefetch(const Program &program, const std::string &directory);
+
+    // the module at a resolved `path`, compiled now if it is not cached or
+    // its file has changed, with its imports prefetched; nullptr if the file
+    // can not be read
+    static std::shared_ptr<const Module> Load(const std::string &path);
+
+  private:
+    static std::shared_ptr<const Module> Get(const std::string &path);
+};
+} // namespace lox
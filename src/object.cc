@@ -1,41 +1,84 @@
 #include "object.h"
 
-#include <sstream>
-#include <iomanip>
+#include <charconv>
+#include <cmath>
+#include "array.h"
 #include "callable.h"
+#include "instance.h"
+#include "list.h"
+#include "map.h"
 
 namespace lox
 {
-std::string ObjectToString(const Object &obj)
+void AppendNumber(std::string &out, double number)
+{
+    // the shortest digits that round-trip, so none are lost and no trailing
+    // zeros are printed; written out in full from 1e-7 up to 1e21, like
+    // JavaScript does, so counts and small fractions stay readable, and in
+    // whichever of fixed or scientific is shorter outside that. 32 chars
+    // covers the longest fixed form, 17 digits after six zeros
+    char buffer[32];
+    double magnitude = std::fabs(number);
+    std::chars_format format =
+        magnitude >= 1e-7 && magnitude < 1e21 ? std::chars_format::fixed : std::chars_format::general;
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number, format);
+    out.append(buffer, result.ptr);
+}
+
+void AppendObject(std::string &out, const Object &obj)
 {
-    return std::visit(
-        [](auto &&arg) -> std::string {
+    std::visit(
+        [&out](auto &&arg) {
             using T = std::decay_t<decltype(arg)>;
             if constexpr (std::is_same_v<T, std::nullptr_t>)
             {
-                return "nil";
+                out += "nil";
             }
             else if constexpr (std::is_same_v<T, double>)
             {
-                std::ostringstream oss;
-                oss << std::defaultfloat << std::setprecision(6) << arg;
-                return oss.str();
+                AppendNumber(out, arg);
             }
             else if constexpr (std::is_same_v<T, bool>) 
             {
-                return arg ? "true" : "false";   
+                out += arg ? "true" : "false";   
             }
             else if constexpr (std::is_same_v<T, std::string>)
             {
-                return arg;
+                out += arg;
             }
             else if constexpr (std::is_same_v<T, CallablePtr>)
             {
-                return arg->ToString();
+                out += arg->ToString();
+            }
+            else if constexpr (std::is_same_v<T, InstancePtr>)
+            {
+                out += arg->ToString();
+            }
+            else if constexpr (std::is_same_v<T, ArrayPtr>)
+            {
+                out += arg->ToString();
+            }
+            else if constexpr (std::is_same_v<T, ListPtr>)
+            {
+                out += arg->ToString();
+            }
+            else if constexpr (std::is_same_v<T, MapPtr>)
+            {
+                out += arg->ToString();
             }
-            return "";
         },
         obj
     );
 }
-} // namespace lox
\ No newline at end of file
+
+std::string ObjectToString(const Object &obj)
+{
+    if (IsObjectInstance<std::string>(obj))
+    {
+        return std::get<std::string>(obj);
+    }
+    std::string str;
+    AppendObject(str, obj);
+    return str;
+}
+} // namespace lox
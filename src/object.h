@@ -2,16 +2,29 @@
 
 #include <variant>
 #include <string>
-#include <memory>
 
 namespace lox
 {
 class Callable;
-using CallablePtr = std::shared_ptr<Callable>;
-using Object = std::variant<std::nullptr_t, double, bool, std::string, CallablePtr>;
+class Instance;
+class Array;
+class List;
+class Map;
+// owned by the interpreter's Heap
+using CallablePtr = Callable *;
+using InstancePtr = Instance *;
+using ArrayPtr = Array *;
+using ListPtr = List *;
+using MapPtr = Map *;
+using Object =
+    std::variant<std::nullptr_t, double, bool, std::string, CallablePtr, InstancePtr, ArrayPtr, ListPtr, MapPtr>;
 
 std::string ObjectToString(const Object& obj);
 
+// append the printed form of a value in place, without a temporary string
+void AppendObject(std::string &out, const Object &obj);
+void AppendNumber(std::string &out, double number);
+
 template <typename T>
 bool IsObjectInstance(const Object& obj)
 {
@@ -0,0 +1,55 @@
+#include "output.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+namespace lox
+{
+Output::Output(std::FILE *file, FlushPolicy policy) : file_(file), policy_(policy)
+{
+    buffer_.reserve(kCapacity);
+}
+
+Output::Output(Sink sink, FlushPolicy policy) : file_(nullptr), sink_(std::move(sink)), policy_(policy)
+{
+    buffer_.reserve(kCapacity);
+}
+
+Output::Output() : file_(nullptr), policy_(FlushPolicy::kNeverUntilExit) {}
+
+Output::~Output()
+{
+    Flush();
+}
+
+Output &Output::Standard()
+{
+    static Output output(stdout, isatty(fileno(stdout)) ? FlushPolicy::kLine : FlushPolicy::kFull);
+    return output;
+}
+
+void Output::Flush()
+{
+    if (buffer_.empty() || (file_ == nullptr && sink_ == nullptr))
+    {
+        return;
+    }
+    // once the reader has gone away (EPIPE with SIGPIPE ignored) the rest is discarded
+    if (!failed_ && sink_ != nullptr)
+    {
+        failed_ = !sink_(buffer_);
+    }
+    else if (!failed_)
+    {
+        failed_ = std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size() || std::fflush(file_) != 0;
+    }
+    buffer_.clear();
+}
+} // namespace lox
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace lox
+{
+// Buffered sink for everything a script prints.
+//
+// print appends to an in-memory buffer that is written out according to the
+// flush policy: after every line, whenever the buffer fills up, or only when
+// Flush() is called at exit. Sync() is called before anything else reaches the
+// terminal (error messages, REPL prompts) so the streams stay ordered.
+class Output
+{
+  public:
+    enum class FlushPolicy
+    {
+        kLine,
+        kFull,
+        kNeverUntilExit
+    };
+
+    // returns false once the reader has gone away
+    using Sink = std::function<bool(std::string_view)>;
+
+    Output(std::FILE *file, FlushPolicy policy);
+    // each flush hands the buffered text to `sink` instead of a file
+    Output(Sink sink, FlushPolicy policy);
+    // in memory: nothing is ever written, everything stays in buffer()
+    Output();
+    ~Output();
+
+    // stdout, line flushed on a terminal and fully buffered when piped
+    static Output &Standard();
+
+    FlushPolicy policy() const
+    {
+        return policy_;
+    }
+
+    void set_policy(FlushPolicy policy)
+    {
+        policy_ = policy;
+    }
+
+    // direct access for writers that format in place
+    std::string &buffer()
+    {
+        return buffer_;
+    }
+
+    void Write(std::string_view text)
+    {
+        buffer_.append(text);
+    }
+
+    void EndLine()
+    {
+        buffer_ += '\n';
+        if (policy_ == FlushPolicy::kLine || (policy_ == FlushPolicy::kFull && buffer_.size() >= kCapacity))
+        {
+            Flush();
+        }
+    }
+
+    void Sync()
+    {
+        if (policy_ != FlushPolicy::kNeverUntilExit)
+        {
+            Flush();
+        }
+    }
+
+    void Flush();
+
+  private:
+    static constexpr size_t kCapacity = 64 * 1024;
+
+    std::FILE *file_;
+    Sink sink_;
+    std::string buffer_;
+    FlushPolicy policy_ = FlushPolicy::kFull;
+    bool failed_ = false;
+};
+} // namespace lox
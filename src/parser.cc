@@ -22,13 +22,31 @@ Program Parser::Parse()
     }
 }
 
+StmtUniquePtr Parser::ParseDeclaration()
+{
+    StmtUniquePtr statement = declaration(true);
+
+    // only Previous() is ever looked at behind the cursor
+    if (current_ > 1)
+    {
+        window_.erase(window_.begin(), window_.begin() + (current_ - 1));
+        current_ = 1;
+    }
+    return statement;
+}
+
 /*
-program        → declaration* EOF ;
+program        → ( importDecl | declaration )* EOF ;
 
-declaration    → funDecl
+importDecl     → "import" STRING ";" ;
+
+declaration    → classDecl
+               | funDecl
                | varDecl
                | statement ;
 
+classDecl      → "class" IDENTIFIER ( "<" IDENTIFIER )?
+                 "{" function* "}" ;
 funDecl        → "fun" function ;
 function       → IDENTIFIER "(" parameters? ")" block ;
 
@@ -66,19 +84,28 @@ Program Parser::program()
 
     while (!IsAtEnd())
     {
-        statements.push_back(std::move(declaration()));
+        statements.push_back(std::move(declaration(true)));
     }
 
     return statements;
 }
 
-// declaration    → funDecl
+// declaration    → classDecl
+//                | funDecl
 //                | varDecl
 //                | statement ;
-StmtUniquePtr Parser::declaration()
+StmtUniquePtr Parser::declaration(bool top_level)
 {
     try
     {
+        if (Match(Token::Type::kImport))
+        {
+            return import_declaration(top_level);
+        }
+        if (Match(Token::Type::kClass))
+        {
+            return class_declaration();
+        }
         if(Match(Token::Type::kFun))
         {
             return func_declaration("function");
@@ -97,6 +124,43 @@ StmtUniquePtr Parser::declaration()
     }
 }
 
+// importDecl     → "import" STRING ";" ;
+StmtUniquePtr Parser::import_declaration(bool top_level)
+{
+    Token keyword = Previous();
+    if (!top_level)
+    {
+        throw ParseError(keyword, "Can only import at the top level.");
+    }
+    Token path = Consume(Token::Type::kString, "Expect module path.");
+    Consume(Token::Type::kSemicolon, "Expect ';' after import.");
+    return std::make_unique<Import>(keyword, path);
+}
+
+// classDecl      → "class" IDENTIFIER ( "<" IDENTIFIER )? "{" function* "}" ;
+StmtUniquePtr Parser::class_declaration()
+{
+    Token name = Consume(Token::Type::kIdentifier, "Expect class name.");
+
+    std::unique_ptr<Variable> superclass;
+    if (Match(Token::Type::kLess))
+    {
+        Consume(Token::Type::kIdentifier, "Expect superclass name.");
+        superclass = std::make_unique<Variable>(Previous());
+    }
+
+    Consume(Token::Type::kLeftBrace, "Expect '{' before class body.");
+
+    std::vector<FunctionUniquePtr> methods;
+    while (!Check(Token::Type::kRightBrace) && !IsAtEnd())
+    {
+        methods.push_back(function("method"));
+    }
+
+    Consume(Token::Type::kRightBrace, "Expect '}' after class body.");
+    return std::make_unique<Class>(name, std::move(superclass), std::move(methods));
+}
+
 // varDecl        → "var" IDENTIFIER ( "=" expression )? ";" ;
 StmtUniquePtr Parser::var_declaration()
 {
@@ -112,11 +176,17 @@ StmtUniquePtr Parser::var_declaration()
     return std::make_unique<Var>(name, std::move(initializer));
 }
 
-//function       → IDENTIFIER "(" parameters? ")" block ;
 StmtUniquePtr Parser::func_declaration(const std::string& kind)
+{
+    return function(kind);
+}
+
+//function       → IDENTIFIER "(" parameters? ")" block ;
+FunctionUniquePtr Parser::function(const std::string& kind)
 {
     Token name = Consume(Token::Type::kIdentifier, "Expect " + kind + " name.");
     Consume(Token::Type::kLeftParen, "Expect '(' after " + kind + " name.");
+    functions_parsed_++;
 
     std::vector<Token> parameters ;
     if (!Check(Token::Type::kRightParen))
@@ -312,7 +382,7 @@ StmtUniquePtr Parser::block()
 
 /*
 expression     → assignment ;
-assignment     → IDENTIFIER "=" assignment
+assignment     → ( call "." )? IDENTIFIER "=" assignment
                | logic_or ;
 logic_or       → logic_and ( "or" logic_and )* ;
 logic_and      → equality ( "and" equality )* ;
@@ -321,10 +391,10 @@ comparison     → term ( ( ">" | ">=" | "<" | "<=" ) term )* ;
 term           → factor ( ( "-" | "+" ) factor )* ;
 factor         → unary ( ( "/" | "*" ) unary )* ;
 unary          → ( "!" | "-" ) unary | call ;
-call           → primary ( "(" arguments? ")" )* ;
-primary        → NUMBER | STRING | "true" | "false" | "nil"
+call           → primary ( "(" arguments? ")" | "." IDENTIFIER )* ;
+primary        → NUMBER | STRING | "true" | "false" | "nil" | "this"
                | "(" expression ")"
-               | IDENTIFIER ;
+               | IDENTIFIER | "super" "." IDENTIFIER ;
 */
 
 // expression     → assignment ;
@@ -333,7 +403,7 @@ ExprUniquePtr Parser::expression()
     return assignment();
 }
 
-// assignment     → IDENTIFIER "=" assignment
+// assignment     → ( call "." )? IDENTIFIER "=" assignment
 //                | logic_or ;
 ExprUniquePtr Parser::assignment()
 {
@@ -351,6 +421,15 @@ ExprUniquePtr Parser::assignment()
             return std::make_unique<Assign>(name, std::move(value));
         }
 
+        Get *get = dynamic_cast<Get *>(expr.get());
+        if (get != nullptr)
+        {
+            // the Get is unwrapped into a Set of the same object and name
+            Token name = get->name();
+            auto object = get->release_object();
+            return std::make_unique<Set>(std::move(object), name, std::move(value));
+        }
+
         throw ParseError(equals, "Invalid assignment target.");
     }
 
@@ -470,7 +549,7 @@ ExprUniquePtr Parser::unary()
     return call();
 }
 
-// call           → primary ( "(" arguments? ")" )* ;
+// call           → primary ( "(" arguments? ")" | "." IDENTIFIER )* ;
 ExprUniquePtr Parser::call()
 {
     ExprUniquePtr expr = primary();
@@ -481,6 +560,11 @@ ExprUniquePtr Parser::call()
         {
             expr = finish_call(std::move(expr));
         }
+        else if (Match(Token::Type::kDot))
+        {
+            Token name = Consume(Token::Type::kIdentifier, "Expect property name after '.'.");
+            expr = std::make_unique<Get>(std::move(expr), name);
+        }
         else
         {
             break;
@@ -510,8 +594,9 @@ ExprUniquePtr Parser::finish_call(ExprUniquePtr callee)
     return std::make_unique<Call>(std::move(callee), paren, std::move(arguments));
 }
 
-// primary        → NUMBER | STRING | "true" | "false" | "nil"
-//                | "(" expression ")" ;
+// primary        → NUMBER | STRING | "true" | "false" | "nil" | "this"
+//                | "(" expression ")"
+//                | IDENTIFIER | "super" "." IDENTIFIER ;
 ExprUniquePtr Parser::primary()
 {
     if (Match(Token::Type::kTrue))
@@ -536,6 +621,19 @@ ExprUniquePtr Parser::primary()
         return std::make_unique<Literal>(Previous().literal());
     }
 
+    if (Match(Token::Type::kThis))
+    {
+        return std::make_unique<This>(Previous());
+    }
+
+    if (Match(Token::Type::kSuper))
+    {
+        Token keyword = Previous();
+        Consume(Token::Type::kDot, "Expect '.' after 'super'.");
+        Token method = Consume(Token::Type::kIdentifier, "Expect superclass method name.");
+        return std::make_unique<Super>(keyword, method);
+    }
+
     if (Match(Token::Type::kIdentifier))
     {
         return std::make_unique<Variable>(Previous());
@@ -599,12 +697,16 @@ bool Parser::IsAtEnd()
 
 Token Parser::Peek()
 {
-    return tokens_.at(current_);
+    if (source_ != nullptr && current_ == window_.size())
+    {
+        window_.push_back(source_->NextToken());
+    }
+    return tokens_->at(current_);
 }
 
 Token Parser::Previous()
 {
-    return tokens_.at(current_ - 1);
+    return tokens_->at(current_ - 1);
 }
 
 Token Parser::Consume(Token::Type type, const std::string &message)
@@ -631,6 +733,7 @@ void Parser::Synchronize()
         switch (Peek().type())
         {
         case Token::Type::kClass:
+        case Token::Type::kImport:
         case Token::Type::kFun:
         case Token::Type::kVar:
         case Token::Type::kFor:
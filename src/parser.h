@@ -10,16 +10,30 @@ namespace lox
 class Parser
 {
 public:
-    Parser(const std::vector<Token>& tokens): tokens_(tokens){}
+    Parser(const std::vector<Token>& tokens): tokens_(&tokens){}
+    // streaming: tokens are pulled from the source as the parser needs them
+    Parser(TokenSource* source): tokens_(&window_), source_(source){}
 
     Program Parse();
-    
+
+    // streaming: parse the next top-level declaration and release the tokens
+    // it consumed; nullptr after a syntax error (already reported)
+    StmtUniquePtr ParseDeclaration();
+    bool IsAtEnd();
+
+    // declarations hold the AST of functions, which must outlive the statement
+    size_t functions_parsed() const { return functions_parsed_; }
+
 private:
     // parse stmt
     Program program();
-    StmtUniquePtr declaration();
+    // `import` is only allowed at the top level
+    StmtUniquePtr declaration(bool top_level = false);
+    StmtUniquePtr import_declaration(bool top_level);
+    StmtUniquePtr class_declaration();
     StmtUniquePtr var_declaration();
     StmtUniquePtr func_declaration(const std::string& kind);
+    FunctionUniquePtr function(const std::string& kind);
     StmtUniquePtr statement();
     StmtUniquePtr return_statement();
     StmtUniquePtr expression_statment();
@@ -49,7 +63,6 @@ private:
     bool Match(Token::Type type);
     bool Check(Token::Type type);
     Token Advance();
-    bool IsAtEnd();
     Token Peek();
     Token Previous();
     Token Consume(Token::Type type, const std::string& message);
@@ -57,7 +70,12 @@ private:
 
 private:
     size_t current_ = 0;
-    const std::vector<Token>& tokens_;
+    const std::vector<Token>* tokens_;
+    size_t functions_parsed_ = 0;
+
+    // streaming state: tokens_ points at window_, refilled from source_
+    TokenSource* source_ = nullptr;
+    std::vector<Token> window_;
 };
 }
 
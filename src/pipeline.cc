@@ -0,0 +1,188 @@
+#include "pipeline.h"
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "error.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "profiler.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "spsc_queue.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace lox
+{
+namespace
+{
+constexpr size_t kTokenBatchSize = 512;
+constexpr size_t kTokenBatchSlots = 64;
+constexpr size_t kStatementSlots = 256;
+
+struct TokenBatch
+{
+    std::vector<Token> tokens;
+    // scan errors, each tagged with the index of the token it was reported before
+    std::vector<std::pair<size_t, ErrorRecord>> errors;
+};
+
+struct Declaration
+{
+    StmtUniquePtr statement;
+    bool declares_function = false;
+    // the last item carries the errors reported after the final declaration
+    bool last = false;
+    std::vector<ErrorRecord> errors;
+};
+
+// parser-side view of the token ring; replays each scan error right before
+// the token it preceded, so the parser thread records it in serial order
+class BatchTokenSource : public TokenSource
+{
+  public:
+    explicit BatchTokenSource(SpscQueue<TokenBatch> &batches) : batches_(batches) {}
+
+    Token NextToken() override
+    {
+        while (index_ == batch_.tokens.size())
+        {
+            batch_ = batches_.Pop();
+            index_ = 0;
+            next_error_ = 0;
+        }
+        while (next_error_ < batch_.errors.size() && batch_.errors[next_error_].first == index_)
+        {
+            Replay(batch_.errors[next_error_++].second);
+        }
+        // EOF is the final token; hand it out again rather than read past it
+        if (batch_.tokens[index_].type() == Token::Type::kEOF)
+        {
+            return batch_.tokens[index_];
+        }
+        return std::move(batch_.tokens[index_++]);
+    }
+
+  private:
+    SpscQueue<TokenBatch> &batches_;
+    TokenBatch batch_;
+    size_t index_ = 0;
+    size_t next_error_ = 0;
+};
+
+void ScanAll(Scanner *scanner, SpscQueue<TokenBatch> *batches)
+{
+    PhaseScope phase(Stats::Phase::kScan);
+    TraceScope trace_scope("phase", "scan");
+    ErrorCapture capture;
+
+    TokenBatch batch;
+    batch.tokens.reserve(kTokenBatchSize);
+    while (true)
+    {
+        Token token = scanner->NextToken();
+        for (ErrorRecord &record : capture.Take())
+        {
+            batch.errors.emplace_back(batch.tokens.size(), std::move(record));
+        }
+        bool at_end = token.type() == Token::Type::kEOF;
+        batch.tokens.push_back(std::move(token));
+        if (at_end || batch.tokens.size() == kTokenBatchSize)
+        {
+            batches->Push(std::move(batch));
+            if (at_end)
+            {
+                return;
+            }
+            batch = TokenBatch();
+            batch.tokens.reserve(kTokenBatchSize);
+        }
+    }
+}
+
+void ParseAll(SpscQueue<TokenBatch> *batches, SpscQueue<Declaration> *declarations)
+{
+    PhaseScope phase(Stats::Phase::kParse);
+    TraceScope trace_scope("phase", "parse");
+    ErrorCapture capture;
+
+    BatchTokenSource source(*batches);
+    Parser parser(&source);
+    Resolver resolver;
+    while (!parser.IsAtEnd())
+    {
+        size_t functions_parsed = parser.functions_parsed();
+        Declaration declaration;
+        declaration.statement = parser.ParseDeclaration();
+        if (declaration.statement != nullptr)
+        {
+            resolver.Resolve(declaration.statement.get());
+        }
+        declaration.declares_function = parser.functions_parsed() != functions_parsed;
+        declaration.errors = capture.Take();
+        declarations->Push(std::move(declaration));
+    }
+
+    Declaration last;
+    last.last = true;
+    last.errors = capture.Take();
+    declarations->Push(std::move(last));
+}
+} // namespace
+
+void RunPipeline(Interpreter *interpreter, std::string source)
+{
+    Scanner scanner(std::move(source));
+    SpscQueue<TokenBatch> batches(kTokenBatchSlots);
+    SpscQueue<Declaration> declarations(kStatementSlots);
+
+    std::thread scan_thread(ScanAll, &scanner, &batches);
+    std::thread parse_thread(ParseAll, &batches, &declarations);
+
+    // same loop as Lox::RunStreaming, fed by the parser thread
+    Program retained;
+    {
+        PhaseScope phase(Stats::Phase::kExecute);
+        TraceScope trace_scope("phase", "interpret");
+        while (true)
+        {
+            Declaration declaration = declarations.Pop();
+            for (const ErrorRecord &record : declaration.errors)
+            {
+                Replay(record);
+            }
+            if (declaration.last)
+            {
+                break;
+            }
+
+            // after a syntax error keep reporting the rest, but run nothing more
+            const ErrorState &errors = CurrentErrorState();
+            if (errors.had_error || errors.had_runtime_error || declaration.statement == nullptr)
+            {
+                continue;
+            }
+
+            interpreter->Interpret(declaration.statement.get());
+
+            if (declaration.declares_function)
+            {
+                retained.push_back(std::move(declaration.statement));
+            }
+            else
+            {
+                interpreter->Discard(std::move(declaration.statement));
+            }
+        }
+    }
+
+    parse_thread.join();
+    scan_thread.join();
+
+    Profiler::Collect();
+    interpreter->Retain(std::move(retained));
+}
+} // namespace lox
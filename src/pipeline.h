@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+namespace lox
+{
+class Interpreter;
+
+// Pipelined front end behind --pipeline: a scanner thread pushes token batches
+// into a ring read by a parser thread, which hands each finished top-level
+// declaration to the calling thread to execute. Scanning and parsing of the
+// rest of the file overlap with execution.
+//
+// Behaves like Lox::RunStreaming, including the order in which syntax, scan
+// and runtime errors are printed: the front-end threads capture their reports
+// and the interpreter thread replays them just before the declaration they
+// were found in.
+void RunPipeline(Interpreter *interpreter, std::string source);
+} // namespace lox
@@ -0,0 +1,181 @@
+#include "profiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "line_finder.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+namespace lox
+{
+namespace
+{
+constexpr long kIntervalMicroseconds = 1000;
+constexpr const char *kRootFrame = "<script>";
+} // namespace
+
+bool Profiler::enabled_ = false;
+std::string Profiler::output_path_;
+const Token *Profiler::frames_[kMaxDepth];
+const stmt::Stmt *Profiler::statements_[kMaxDepth + 1];
+volatile std::sig_atomic_t Profiler::depth_ = 0;
+uintptr_t *Profiler::buffer_ = nullptr;
+volatile size_t Profiler::buffer_end_ = 0;
+volatile size_t Profiler::dropped_ = 0;
+std::map<std::string, uint64_t> Profiler::collapsed_;
+uint64_t Profiler::sample_count_ = 0;
+
+#ifdef _WIN32
+
+bool Profiler::Start(const std::string &)
+{
+    std::cerr << "--profile is not supported on this platform." << std::endl;
+    return false;
+}
+
+void Profiler::Collect() {}
+
+void Profiler::Stop() {}
+
+void Profiler::HandleSample(int) {}
+
+#else
+
+bool Profiler::Start(const std::string &output_path)
+{
+    output_path_ = output_path;
+    buffer_ = new uintptr_t[kBufferSize];
+
+    struct sigaction action = {};
+    action.sa_handler = &Profiler::HandleSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0)
+    {
+        std::cerr << "can not install the profiler signal handler." << std::endl;
+        return false;
+    }
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = kIntervalMicroseconds;
+    timer.it_value.tv_usec = kIntervalMicroseconds;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+        std::cerr << "can not start the profiler timer." << std::endl;
+        return false;
+    }
+
+    enabled_ = true;
+    return true;
+}
+
+// runs in signal context: only plain loads and stores into preallocated memory
+void Profiler::HandleSample(int)
+{
+    size_t depth = depth_ < kMaxDepth ? depth_ : kMaxDepth;
+    size_t end = buffer_end_;
+    size_t size = 2 + 2 * depth;
+    if (end + size > kBufferSize)
+    {
+        dropped_ = dropped_ + 1;
+        return;
+    }
+    buffer_[end] = depth;
+    buffer_[end + 1] = reinterpret_cast<uintptr_t>(statements_[0]);
+    for (size_t i = 0; i < depth; i++)
+    {
+        buffer_[end + 2 + 2 * i] = reinterpret_cast<uintptr_t>(frames_[i]);
+        buffer_[end + 3 + 2 * i] = reinterpret_cast<uintptr_t>(statements_[i + 1]);
+    }
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    buffer_end_ = end + size;
+}
+
+void Profiler::Collect()
+{
+    if (!enabled_)
+    {
+        return;
+    }
+
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPROF);
+    sigprocmask(SIG_BLOCK, &block, nullptr);
+
+    // a frame that has not started a statement yet is on its declaration's line
+    std::unordered_map<uintptr_t, size_t> lines;
+    auto line_of = [&](uintptr_t statement, size_t fallback) {
+        if (statement == 0)
+        {
+            return fallback;
+        }
+        auto [it, inserted] = lines.try_emplace(statement);
+        if (inserted)
+        {
+            it->second = LineOf(reinterpret_cast<stmt::Stmt *>(statement));
+        }
+        return it->second != 0 ? it->second : fallback;
+    };
+
+    size_t pos = 0;
+    std::string stack;
+    while (pos < buffer_end_)
+    {
+        size_t depth = buffer_[pos++];
+        stack = kRootFrame;
+        stack += ":" + std::to_string(line_of(buffer_[pos++], 0));
+        for (size_t i = 0; i < depth; i++)
+        {
+            const Token *name = reinterpret_cast<const Token *>(buffer_[pos++]);
+            size_t line = line_of(buffer_[pos++], name->line());
+            stack += ";" + name->lexeme() + ":" + std::to_string(line);
+        }
+        collapsed_[stack]++;
+        sample_count_++;
+    }
+    buffer_end_ = 0;
+
+    sigprocmask(SIG_UNBLOCK, &block, nullptr);
+}
+
+void Profiler::Stop()
+{
+    if (!enabled_)
+    {
+        return;
+    }
+
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    Collect();
+    enabled_ = false;
+
+    std::ofstream file(output_path_);
+    if (!file.is_open())
+    {
+        std::cerr << "can not open file: " + output_path_ << std::endl;
+        return;
+    }
+    for (const auto &[stack, count] : collapsed_)
+    {
+        file << stack << " " << count << "\n";
+    }
+
+    std::cerr << "profile: " << sample_count_ << " samples written to " << output_path_;
+    if (dropped_ > 0)
+    {
+        std::cerr << " (" << dropped_ << " dropped, buffer full)";
+    }
+    std::cerr << std::endl;
+
+    delete[] buffer_;
+    buffer_ = nullptr;
+}
+
+#endif
+} // namespace lox
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "token.h"
+
+namespace lox
+{
+namespace stmt
+{
+class Stmt;
+}
+
+// Sampling profiler behind --profile.
+//
+// UserDefineCallable::Call pushes the name token of the running function onto a
+// fixed-size shadow stack, and Interpreter::Execute records the statement each
+// frame is running; a SIGPROF interval timer copies that stack into a
+// preallocated sample buffer. Collect() folds the raw samples into collapsed
+// stacks of function names and current lines ("<script>:12;outer:5;inner:9 42")
+// and must run while the AST the samples point into is still alive. Stop()
+// writes the result for flamegraph tools.
+class Profiler
+{
+  public:
+    static bool Start(const std::string &output_path);
+    static void Collect();
+    static void Stop();
+
+    static bool enabled()
+    {
+        return enabled_;
+    }
+
+    static void Push(const Token *function_name)
+    {
+        if (depth_ < kMaxDepth)
+        {
+            frames_[depth_] = function_name;
+            statements_[depth_ + 1] = nullptr;
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        depth_ = depth_ + 1;
+    }
+
+    static void Pop()
+    {
+        depth_ = depth_ - 1;
+    }
+
+    // the statement the innermost frame has started
+    static void Enter(const stmt::Stmt *statement)
+    {
+        if (depth_ <= kMaxDepth)
+        {
+            statements_[depth_] = statement;
+        }
+    }
+
+  private:
+    static void HandleSample(int signal);
+
+  private:
+    static constexpr std::sig_atomic_t kMaxDepth = 512;
+    static constexpr size_t kBufferSize = size_t(1) << 22;
+
+    static bool enabled_;
+    static std::string output_path_;
+    static const Token *frames_[kMaxDepth];
+    // one more than frames_: the top level runs statements too
+    static const stmt::Stmt *statements_[kMaxDepth + 1];
+    static volatile std::sig_atomic_t depth_;
+
+    // each raw sample is stored as its depth, the top level's statement and
+    // then a name and a statement for each frame
+    static uintptr_t *buffer_;
+    static volatile size_t buffer_end_;
+    static volatile size_t dropped_;
+
+    static std::map<std::string, uint64_t> collapsed_;
+    static uint64_t sample_count_;
+};
+
+class ProfilerFrame
+{
+  public:
+    ProfilerFrame(const Token *function_name) : active_(Profiler::enabled())
+    {
+        if (active_)
+        {
+            Profiler::Push(function_name);
+        }
+    }
+
+    ~ProfilerFrame()
+    {
+        if (active_)
+        {
+            Profiler::Pop();
+        }
+    }
+
+  private:
+    bool active_;
+};
+} // namespace lox
@@ -0,0 +1,249 @@
+#include "pure_function.h"
+
+#include <unordered_set>
+
+#include "callable.h"
+#include "environment.h"
+#include "interpreter.h"
+
+namespace lox
+{
+using namespace expr;
+using namespace stmt;
+
+namespace
+{
+// natives with an effect outside the call
+const char *const kImpureNatives[] = {"bench"};
+
+// Walks a function body, and those of the global functions it reads, for
+// anything a worker could not repeat, collecting the globals it reads.
+class PurityChecker : public ExprVisitor, public StmtVisitor
+{
+  public:
+    PurityChecker(
+        Environment *globals, std::vector<std::pair<std::string, Object>> *values,
+        std::vector<std::pair<std::string, stmt::Function *>> *functions
+    )
+        : globals_(globals), values_(values), functions_(functions)
+    {
+    }
+
+    bool Check(Expr *expr)
+    {
+        return expr == nullptr || std::get<bool>(expr->Accept(this));
+    }
+    bool Check(Stmt *stmt)
+    {
+        return stmt == nullptr || std::get<bool>(stmt->Accept(this));
+    }
+
+    Object Visit(Binary *expr) override
+    {
+        return Check(expr->left()) && Check(expr->right());
+    }
+    Object Visit(Grouping *expr) override
+    {
+        return Check(expr->expression());
+    }
+    Object Visit(Literal *) override
+    {
+        return true;
+    }
+    Object Visit(Unary *expr) override
+    {
+        return Check(expr->right());
+    }
+    Object Visit(Variable *expr) override
+    {
+        return expr->slot().kind != VariableSlot::Kind::kGlobal || Global(expr->name().lexeme());
+    }
+    Object Visit(Assign *expr) override
+    {
+        return expr->slot().kind != VariableSlot::Kind::kGlobal && Check(expr->value());
+    }
+    Object Visit(Logical *expr) override
+    {
+        return Check(expr->left()) && Check(expr->right());
+    }
+    Object Visit(Call *expr) override
+    {
+        if (!Check(expr->callee()))
+        {
+            return false;
+        }
+        for (const ExprUniquePtr &argument : expr->arguments())
+        {
+            if (!Check(argument.get()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    Object Visit(Get *expr) override
+    {
+        return Check(expr->object());
+    }
+    Object Visit(Set *expr) override
+    {
+        return Check(expr->object()) && Check(expr->value());
+    }
+    Object Visit(This *) override
+    {
+        return true;
+    }
+    Object Visit(Super *) override
+    {
+        return true;
+    }
+
+    Object Visit(Expression *stmt) override
+    {
+        return Check(stmt->expression());
+    }
+    Object Visit(Print *) override
+    {
+        return false;
+    }
+    Object Visit(Var *stmt) override
+    {
+        return stmt->slot().kind != VariableSlot::Kind::kGlobal && Check(stmt->initializer());
+    }
+    Object Visit(Block *stmt) override
+    {
+        for (const StmtUniquePtr &statement : stmt->statements())
+        {
+            if (!Check(statement.get()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    Object Visit(If *stmt) override
+    {
+        return Check(stmt->condition()) && Check(stmt->then_branch()) && Check(stmt->else_branch());
+    }
+    Object Visit(While *stmt) override
+    {
+        return Check(stmt->condition()) && Check(stmt->body());
+    }
+    Object Visit(stmt::Function *stmt) override
+    {
+        return stmt->slot().kind != VariableSlot::Kind::kGlobal && Check(stmt->body());
+    }
+    Object Visit(Return *stmt) override
+    {
+        return Check(stmt->value());
+    }
+    Object Visit(Class *stmt) override
+    {
+        if (stmt->slot().kind == VariableSlot::Kind::kGlobal || !Check(stmt->superclass()))
+        {
+            return false;
+        }
+        for (const FunctionUniquePtr &method : stmt->methods())
+        {
+            if (!Check(method->body()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    Object Visit(Import *) override
+    {
+        return false;
+    }
+
+  private:
+    // a global is read by name when the worker runs, so it has to be one the
+    // worker either has already (an untouched native) or can be given
+    bool Global(const std::string &name)
+    {
+        if (!seen_.insert(name).second)
+        {
+            return true;
+        }
+        auto found = globals_->values().find(name);
+        if (found == globals_->values().end())
+        {
+            return false;
+        }
+        const Object &value = found->second;
+        if (PureFunction::IsPlain(value))
+        {
+            values_->emplace_back(name, value);
+            return true;
+        }
+        if (!IsObjectInstance<CallablePtr>(value))
+        {
+            return false;
+        }
+        Callable *callable = std::get<CallablePtr>(value);
+        if (auto *native = dynamic_cast<BuiltinCallable *>(callable))
+        {
+            for (const char *impure : kImpureNatives)
+            {
+                if (name == impure)
+                {
+                    return false;
+                }
+            }
+            return native->name() == name;
+        }
+        auto *function = dynamic_cast<UserDefineCallable *>(callable);
+        if (function == nullptr || !function->upvalues().empty() || function->initializer())
+        {
+            return false;
+        }
+        functions_->emplace_back(name, function->declaration());
+        return Check(function->declaration()->body());
+    }
+
+  private:
+    Environment *globals_;
+    std::vector<std::pair<std::string, Object>> *values_;
+    std::vector<std::pair<std::string, stmt::Function *>> *functions_;
+    std::unordered_set<std::string> seen_;
+};
+} // namespace
+
+std::unique_ptr<PureFunction> PureFunction::Find(Callable *function, Interpreter *interpreter)
+{
+    auto *user = dynamic_cast<UserDefineCallable *>(function);
+    if (user == nullptr || !user->upvalues().empty() || user->initializer())
+    {
+        return nullptr;
+    }
+    auto pure = std::make_unique<PureFunction>();
+    pure->declaration_ = user->declaration();
+    PurityChecker checker(interpreter->globals(), &pure->values_, &pure->functions_);
+    if (!checker.Check(pure->declaration_->body()))
+    {
+        return nullptr;
+    }
+    return pure;
+}
+
+Callable *PureFunction::Install(Interpreter *worker) const
+{
+    Heap &heap = worker->heap();
+    for (const auto &[name, value] : values_)
+    {
+        worker->globals()->Define(name, value);
+    }
+    for (const auto &[name, declaration] : functions_)
+    {
+        worker->globals()->Define(name, heap.Allocate<UserDefineCallable>(declaration));
+    }
+    return heap.Allocate<UserDefineCallable>(declaration_);
+}
+
+bool PureFunction::IsPlain(const Object &value)
+{
+    return IsObjectInstance<std::nullptr_t>(value) || IsObjectInstance<bool>(value) ||
+           IsObjectInstance<double>(value) || IsObjectInstance<std::string>(value);
+}
+} // namespace lox
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "object.h"
+
+namespace lox
+{
+class Callable;
+class Interpreter;
+
+// A function that gives the same result on a fresh Interpreter, on another
+// thread, as on its own: it captures no variables, prints nothing, assigns no
+// global, and every global it reads, directly or through the functions it
+// calls, is a native, a plain value or another such function. Whatever it
+// creates stays local to the call, so with plain arguments it leaves no trace
+// on either Interpreter.
+class PureFunction
+{
+  public:
+    // nullptr unless `function` is pure with the globals `interpreter` has now
+    static std::unique_ptr<PureFunction> Find(Callable *function, Interpreter *interpreter);
+
+    // defines the globals the function reads in `worker`, a fresh Interpreter,
+    // and returns the function allocated there; the caller keeps it rooted
+    Callable *Install(Interpreter *worker) const;
+
+    // nil, a boolean, a number or a string, which any Interpreter can hold
+    static bool IsPlain(const Object &value);
+
+  private:
+    stmt::Function *declaration_ = nullptr;
+    std::vector<std::pair<std::string, Object>> values_;
+    std::vector<std::pair<std::string, stmt::Function *>> functions_;
+};
+} // namespace lox
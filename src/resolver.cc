@@ -0,0 +1,340 @@
+#include "resolver.h"
+
+using namespace lox;
+using namespace lox::expr;
+using namespace lox::stmt;
+
+void Resolver::Resolve(Stmt *statement)
+{
+    functions_.clear();
+    functions_.emplace_back();
+    ResolveStmt(statement);
+    FinishFunction(functions_.back());
+    functions_.clear();
+}
+
+Object Resolver::Visit(Binary *expr)
+{
+    ResolveExpr(expr->left());
+    ResolveExpr(expr->right());
+    return nullptr;
+}
+
+Object Resolver::Visit(Grouping *expr)
+{
+    ResolveExpr(expr->expression());
+    return nullptr;
+}
+
+Object Resolver::Visit(Literal *)
+{
+    return nullptr;
+}
+
+Object Resolver::Visit(Unary *expr)
+{
+    ResolveExpr(expr->right());
+    return nullptr;
+}
+
+Object Resolver::Visit(Variable *expr)
+{
+    ResolveName(expr->name().lexeme(), &expr->slot());
+    return nullptr;
+}
+
+Object Resolver::Visit(Assign *expr)
+{
+    ResolveExpr(expr->value());
+    ResolveName(expr->name().lexeme(), &expr->slot());
+    return nullptr;
+}
+
+Object Resolver::Visit(Logical *expr)
+{
+    ResolveExpr(expr->left());
+    ResolveExpr(expr->right());
+    return nullptr;
+}
+
+Object Resolver::Visit(Call *expr)
+{
+    ResolveExpr(expr->callee());
+    for (const ExprUniquePtr &argument : expr->arguments())
+    {
+        ResolveExpr(argument.get());
+    }
+    return nullptr;
+}
+
+Object Resolver::Visit(Get *expr)
+{
+    ResolveExpr(expr->object());
+    return nullptr;
+}
+
+Object Resolver::Visit(Set *expr)
+{
+    ResolveExpr(expr->object());
+    ResolveExpr(expr->value());
+    return nullptr;
+}
+
+Object Resolver::Visit(This *expr)
+{
+    // outside a method this finds no local and fails at runtime as an undefined global
+    ResolveName("this", &expr->slot());
+    return nullptr;
+}
+
+Object Resolver::Visit(Super *expr)
+{
+    ResolveName("super", &expr->slot());
+    ResolveName("this", &expr->this_slot());
+    return nullptr;
+}
+
+Object Resolver::Visit(Expression *stmt)
+{
+    ResolveExpr(stmt->expression());
+    return nullptr;
+}
+
+Object Resolver::Visit(Print *stmt)
+{
+    ResolveExpr(stmt->expression());
+    return nullptr;
+}
+
+Object Resolver::Visit(Var *stmt)
+{
+    // the initializer still sees any outer variable of the same name
+    ResolveExpr(stmt->initializer());
+    Declare(stmt->name().lexeme(), &stmt->slot());
+    return nullptr;
+}
+
+Object Resolver::Visit(Block *stmt)
+{
+    functions_.back().scopes.emplace_back();
+    ResolveStatements(stmt->statements());
+    functions_.back().scopes.pop_back();
+    return nullptr;
+}
+
+Object Resolver::Visit(If *stmt)
+{
+    ResolveExpr(stmt->condition());
+    ResolveStmt(stmt->then_branch());
+    ResolveStmt(stmt->else_branch());
+    return nullptr;
+}
+
+Object Resolver::Visit(While *stmt)
+{
+    ResolveExpr(stmt->condition());
+    ResolveStmt(stmt->body());
+    return nullptr;
+}
+
+Object Resolver::Visit(Function *stmt)
+{
+    // declared first so the body can call itself
+    Declare(stmt->name().lexeme(), &stmt->slot());
+    ResolveFunction(stmt, false);
+    return nullptr;
+}
+
+Object Resolver::Visit(Return *stmt)
+{
+    ResolveExpr(stmt->value());
+    return nullptr;
+}
+
+Object Resolver::Visit(Import *)
+{
+    // the module is resolved on its own when it is loaded
+    return nullptr;
+}
+
+Object Resolver::Visit(Class *stmt)
+{
+    Declare(stmt->name().lexeme(), &stmt->slot());
+    if (stmt->superclass() == nullptr)
+    {
+        for (const FunctionUniquePtr &method : stmt->methods())
+        {
+            ResolveFunction(method.get(), true);
+        }
+        return nullptr;
+    }
+
+    ResolveExpr(stmt->superclass());
+    functions_.back().scopes.emplace_back();
+    Declare("super", &stmt->super_slot());
+    for (const FunctionUniquePtr &method : stmt->methods())
+    {
+        ResolveFunction(method.get(), true);
+    }
+    functions_.back().scopes.pop_back();
+    return nullptr;
+}
+
+void Resolver::ResolveFunction(Function *function, bool method)
+{
+    function->upvalues().clear();
+    functions_.emplace_back();
+    functions_.back().function = function;
+    functions_.back().scopes.emplace_back();
+    if (method)
+    {
+        Declare("this", &function->this_slot());
+    }
+    for (size_t i = 0; i < function->params().size(); i++)
+    {
+        Declare(function->params()[i].lexeme(), &function->param_slots()[i]);
+    }
+    // parameters and the top level of the body share one scope, as they do at runtime
+    if (auto *body = dynamic_cast<Block *>(function->body()))
+    {
+        ResolveStatements(body->statements());
+    }
+    // nested functions may have reallocated functions_, so no reference is kept across the body
+    FinishFunction(functions_.back());
+    functions_.pop_back();
+}
+
+void Resolver::ResolveExpr(Expr *expr)
+{
+    if (expr != nullptr)
+    {
+        expr->Accept(this);
+    }
+}
+
+void Resolver::ResolveStmt(Stmt *stmt)
+{
+    if (stmt != nullptr)
+    {
+        stmt->Accept(this);
+    }
+}
+
+void Resolver::ResolveStatements(const StmtList &statements)
+{
+    for (const StmtUniquePtr &statement : statements)
+    {
+        ResolveStmt(statement.get());
+    }
+}
+
+void Resolver::Declare(const std::string &name, VariableSlot *slot)
+{
+    FunctionScope &function = functions_.back();
+    if (function.scopes.empty())
+    {
+        *slot = VariableSlot();
+        return;
+    }
+
+    // redeclaring a name in the same scope rebinds the same variable
+    auto [it, inserted] = function.scopes.back().emplace(name, function.locals.size());
+    if (inserted)
+    {
+        function.locals.emplace_back();
+    }
+    function.locals[it->second].uses.push_back(slot);
+}
+
+void Resolver::ResolveName(const std::string &name, VariableSlot *slot)
+{
+    size_t id;
+    if (FindLocal(functions_.back(), name, &id))
+    {
+        functions_.back().locals[id].uses.push_back(slot);
+    }
+    else if (ResolveUpvalue(functions_.size() - 1, name, &id))
+    {
+        slot->kind = VariableSlot::Kind::kUpvalue;
+        slot->index = static_cast<uint32_t>(id);
+    }
+    else
+    {
+        *slot = VariableSlot();
+    }
+}
+
+bool Resolver::FindLocal(const FunctionScope &function, const std::string &name, size_t *id)
+{
+    for (auto scope = function.scopes.rbegin(); scope != function.scopes.rend(); ++scope)
+    {
+        auto it = scope->find(name);
+        if (it != scope->end())
+        {
+            *id = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Resolver::ResolveUpvalue(size_t level, const std::string &name, size_t *upvalue)
+{
+    if (level == 0)
+    {
+        return false;
+    }
+
+    FunctionScope &enclosing = functions_[level - 1];
+    size_t id;
+    if (FindLocal(enclosing, name, &id))
+    {
+        enclosing.locals[id].captured = true;
+        *upvalue = AddUpvalue(level, true, id);
+        return true;
+    }
+    if (ResolveUpvalue(level - 1, name, &id))
+    {
+        *upvalue = AddUpvalue(level, false, id);
+        return true;
+    }
+    return false;
+}
+
+size_t Resolver::AddUpvalue(size_t level, bool from_cell, size_t index)
+{
+    FunctionScope &function = functions_[level];
+    auto [it, inserted] = function.upvalue_ids.emplace(std::make_pair(from_cell, index), 0);
+    if (inserted)
+    {
+        std::vector<UpvalueSource> &upvalues = function.function->upvalues();
+        it->second = upvalues.size();
+        // a cell's index is only known once the enclosing function is finished
+        upvalues.push_back(UpvalueSource{from_cell, static_cast<uint32_t>(index)});
+        if (from_cell)
+        {
+            functions_[level - 1].locals[index].captures.emplace_back(function.function, it->second);
+        }
+    }
+    return it->second;
+}
+
+void Resolver::FinishFunction(FunctionScope &function)
+{
+    uint32_t locals = 0;
+    uint32_t cells = 0;
+    for (Local &local : function.locals)
+    {
+        VariableSlot slot;
+        slot.kind = local.captured ? VariableSlot::Kind::kCell : VariableSlot::Kind::kLocal;
+        slot.index = local.captured ? cells++ : locals++;
+        for (VariableSlot *use : local.uses)
+        {
+            *use = slot;
+        }
+        for (const auto &[capturing, upvalue] : local.captures)
+        {
+            capturing->upvalues()[upvalue].index = slot.index;
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+
+namespace lox
+{
+// Static pass between the Parser and the Interpreter that fills in every
+// VariableSlot and each function's upvalue list.
+//
+// Names declared outside any block or function are globals and stay dynamic.
+// Everything else becomes a numbered slot of its function's frame. `this` is
+// an ordinary local of every method, and `super` one of a scope wrapped around
+// the methods of a subclass, so closures capture both like any variable. The pass
+// doubles as escape analysis: only a local that some nested function refers
+// to is marked captured, and only those are given a heap cell; a closure then
+// copies exactly the cells it uses, so creating one and reaching a captured
+// variable cost the same however deeply the scopes are nested.
+class Resolver : public expr::ExprVisitor, public stmt::StmtVisitor
+{
+  public:
+    // resolves one top-level statement; code outside functions runs in a
+    // frame of its own, for the locals of top-level blocks
+    void Resolve(stmt::Stmt *statement);
+
+    Object Visit(expr::Binary *expr) override;
+    Object Visit(expr::Grouping *expr) override;
+    Object Visit(expr::Literal *expr) override;
+    Object Visit(expr::Unary *expr) override;
+    Object Visit(expr::Variable *expr) override;
+    Object Visit(expr::Assign *expr) override;
+    Object Visit(expr::Logical *expr) override;
+    Object Visit(expr::Call *expr) override;
+    Object Visit(expr::Get *expr) override;
+    Object Visit(expr::Set *expr) override;
+    Object Visit(expr::This *expr) override;
+    Object Visit(expr::Super *expr) override;
+
+    Object Visit(stmt::Expression *stmt) override;
+    Object Visit(stmt::Print *stmt) override;
+    Object Visit(stmt::Var *stmt) override;
+    Object Visit(stmt::Block *stmt) override;
+    Object Visit(stmt::If *stmt) override;
+    Object Visit(stmt::While *stmt) override;
+    Object Visit(stmt::Function *stmt) override;
+    Object Visit(stmt::Return *stmt) override;
+    Object Visit(stmt::Class *stmt) override;
+    Object Visit(stmt::Import *stmt) override;
+
+  private:
+    // one local variable; slots are only numbered once its function is done,
+    // when it is known whether anything captured it
+    struct Local
+    {
+        bool captured = false;
+        std::vector<VariableSlot *> uses;
+        // (capturing function, upvalue index) pairs that read its cell
+        std::vector<std::pair<stmt::Function *, size_t>> captures;
+    };
+
+    struct FunctionScope
+    {
+        // nullptr for the top-level frame
+        stmt::Function *function = nullptr;
+        std::vector<std::unordered_map<std::string, size_t>> scopes;
+        std::vector<Local> locals;
+        // (from_cell, local or upvalue index) -> upvalue index
+        std::map<std::pair<bool, size_t>, size_t> upvalue_ids;
+    };
+
+    void ResolveExpr(expr::Expr *expr);
+    void ResolveStmt(stmt::Stmt *stmt);
+    void ResolveStatements(const StmtList &statements);
+    // a method also binds `this`, as the first local of its frame
+    void ResolveFunction(stmt::Function *function, bool method);
+
+    void Declare(const std::string &name, VariableSlot *slot);
+    void ResolveName(const std::string &name, VariableSlot *slot);
+    bool FindLocal(const FunctionScope &function, const std::string &name, size_t *id);
+    bool ResolveUpvalue(size_t level, const std::string &name, size_t *upvalue);
+    size_t AddUpvalue(size_t level, bool from_cell, size_t index);
+    void FinishFunction(FunctionScope &function);
+
+  private:
+    std::vector<FunctionScope> functions_;
+};
+} // namespace lox
@@ -0,0 +1,351 @@
+#include "scan_simd.h"
+
+#include <cstdint>
+
+#include "char_class.h"
+#include "cpu.h"
+
+#ifdef LOX_X86
+#include <immintrin.h>
+#endif
+
+namespace lox
+{
+namespace
+{
+constexpr bool IsWhitespace(char c)
+{
+    return HasCharClass(c, kCharWhitespace);
+}
+
+constexpr bool IsIdentifier(char c)
+{
+    return HasCharClass(c, kCharAlpha | kCharDigit);
+}
+
+// scalar versions, also used for the tails shorter than one vector
+
+const char *SkipWhitespaceScalar(const char *p, const char *end, size_t *newlines)
+{
+    for (; p < end && IsWhitespace(*p); p++)
+    {
+        *newlines += *p == '\n';
+    }
+    return p;
+}
+
+const char *FindLineEndScalar(const char *p, const char *end)
+{
+    while (p < end && *p != '\n')
+    {
+        p++;
+    }
+    return p;
+}
+
+const char *FindStringEndScalar(const char *p, const char *end, size_t *newlines)
+{
+    for (; p < end && *p != '"'; p++)
+    {
+        *newlines += *p == '\n';
+    }
+    return p;
+}
+
+const char *IdentifierEndScalar(const char *p, const char *end)
+{
+    while (p < end && IsIdentifier(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+// length of the well-formed UTF-8 sequence starting at p (RFC 3629: no
+// overlongs, surrogates or code points past U+10FFFF), 0 if there is none
+size_t Utf8SequenceLength(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char lead = p[0];
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+
+    size_t length;
+    unsigned char min = 0x80;
+    unsigned char max = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        length = 3;
+        min = lead == 0xE0 ? 0xA0 : 0x80;
+        max = lead == 0xED ? 0x9F : 0xBF;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        min = lead == 0xF0 ? 0x90 : 0x80;
+        max = lead == 0xF4 ? 0x8F : 0xBF;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (static_cast<size_t>(end - p) < length || p[1] < min || p[1] > max)
+    {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++)
+    {
+        if (p[i] < 0x80 || p[i] > 0xBF)
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+const char *FindInvalidUtf8Scalar(const char *p, const char *end)
+{
+    auto *byte = reinterpret_cast<const unsigned char *>(p);
+    auto *byte_end = reinterpret_cast<const unsigned char *>(end);
+    while (byte < byte_end)
+    {
+        size_t length = Utf8SequenceLength(byte, byte_end);
+        if (length == 0)
+        {
+            break;
+        }
+        byte += length;
+    }
+    return reinterpret_cast<const char *>(byte);
+}
+
+#ifdef LOX_X86
+
+// Each ISA provides per-block masks (bit i describes byte i); the loops below
+// are shared. The mask functions carry the target attribute, so they are
+// called rather than inlined into the generic loops.
+
+struct Sse2
+{
+    static constexpr size_t kWidth = 16;
+    static constexpr uint32_t kFull = 0xFFFF;
+
+    static __m128i InRange(__m128i v, char first, int count)
+    {
+        // shift the range to start at -128 so one signed compare tests both bounds
+        __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - first)));
+        return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + count)));
+    }
+
+    static uint32_t WhitespaceMask(const char *p, uint32_t *newline_mask)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        __m128i space = _mm_or_si128(_mm_or_si128(blank, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))), newline);
+        *newline_mask = _mm_movemask_epi8(newline);
+        return _mm_movemask_epi8(space);
+    }
+
+    static uint32_t CharMask(const char *p, char c)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    }
+
+    static uint32_t QuoteMask(const char *p, uint32_t *newline_mask)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        *newline_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    }
+
+    static uint32_t IdentifierMask(const char *p)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i letter = _mm_or_si128(InRange(v, 'a', 26), InRange(v, 'A', 26));
+        __m128i rest = _mm_or_si128(InRange(v, '0', 10), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        return _mm_movemask_epi8(_mm_or_si128(letter, rest));
+    }
+
+    static uint32_t NonAsciiMask(const char *p)
+    {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+};
+
+struct Avx2
+{
+    static constexpr size_t kWidth = 32;
+    static constexpr uint32_t kFull = 0xFFFFFFFF;
+
+    LOX_TARGET_AVX2 static __m256i InRange(__m256i v, char first, int count)
+    {
+        __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - first)));
+        return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + count)), shifted);
+    }
+
+    LOX_TARGET_AVX2 static uint32_t WhitespaceMask(const char *p, uint32_t *newline_mask)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i blank =
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        __m256i space = _mm256_or_si256(_mm256_or_si256(blank, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))), newline);
+        *newline_mask = static_cast<uint32_t>(_mm256_movemask_epi8(newline));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(space));
+    }
+
+    LOX_TARGET_AVX2 static uint32_t CharMask(const char *p, char c)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+    }
+
+    LOX_TARGET_AVX2 static uint32_t QuoteMask(const char *p, uint32_t *newline_mask)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        *newline_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))));
+    }
+
+    LOX_TARGET_AVX2 static uint32_t IdentifierMask(const char *p)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i letter = _mm256_or_si256(InRange(v, 'a', 26), InRange(v, 'A', 26));
+        __m256i rest = _mm256_or_si256(InRange(v, '0', 10), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(letter, rest)));
+    }
+
+    LOX_TARGET_AVX2 static uint32_t NonAsciiMask(const char *p)
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))));
+    }
+};
+
+template <typename Isa>
+const char *SkipWhitespace(const char *p, const char *end, size_t *newlines)
+{
+    while (static_cast<size_t>(end - p) >= Isa::kWidth)
+    {
+        uint32_t newline_mask;
+        uint32_t mask = Isa::WhitespaceMask(p, &newline_mask);
+        if (mask != Isa::kFull)
+        {
+            unsigned run = CountTrailingZeros(~mask);
+            *newlines += PopCount(newline_mask & ((uint32_t(1) << run) - 1));
+            return p + run;
+        }
+        *newlines += PopCount(newline_mask);
+        p += Isa::kWidth;
+    }
+    return SkipWhitespaceScalar(p, end, newlines);
+}
+
+template <typename Isa>
+const char *FindLineEnd(const char *p, const char *end)
+{
+    while (static_cast<size_t>(end - p) >= Isa::kWidth)
+    {
+        uint32_t mask = Isa::CharMask(p, '\n');
+        if (mask != 0)
+        {
+            return p + CountTrailingZeros(mask);
+        }
+        p += Isa::kWidth;
+    }
+    return FindLineEndScalar(p, end);
+}
+
+template <typename Isa>
+const char *FindStringEnd(const char *p, const char *end, size_t *newlines)
+{
+    while (static_cast<size_t>(end - p) >= Isa::kWidth)
+    {
+        uint32_t newline_mask;
+        uint32_t mask = Isa::QuoteMask(p, &newline_mask);
+        if (mask != 0)
+        {
+            unsigned run = CountTrailingZeros(mask);
+            *newlines += PopCount(newline_mask & ((uint32_t(1) << run) - 1));
+            return p + run;
+        }
+        *newlines += PopCount(newline_mask);
+        p += Isa::kWidth;
+    }
+    return FindStringEndScalar(p, end, newlines);
+}
+
+template <typename Isa>
+const char *IdentifierEnd(const char *p, const char *end)
+{
+    while (static_cast<size_t>(end - p) >= Isa::kWidth)
+    {
+        uint32_t mask = Isa::IdentifierMask(p);
+        if (mask != Isa::kFull)
+        {
+            return p + CountTrailingZeros(~mask);
+        }
+        p += Isa::kWidth;
+    }
+    return IdentifierEndScalar(p, end);
+}
+
+// ASCII blocks are skipped a vector at a time; multi-byte sequences are
+// checked one by one from the first non-ASCII byte
+template <typename Isa>
+const char *FindInvalidUtf8(const char *p, const char *end)
+{
+    auto *byte_end = reinterpret_cast<const unsigned char *>(end);
+    while (static_cast<size_t>(end - p) >= Isa::kWidth)
+    {
+        uint32_t mask = Isa::NonAsciiMask(p);
+        if (mask == 0)
+        {
+            p += Isa::kWidth;
+            continue;
+        }
+        p += CountTrailingZeros(mask);
+        size_t length = Utf8SequenceLength(reinterpret_cast<const unsigned char *>(p), byte_end);
+        if (length == 0)
+        {
+            return p;
+        }
+        p += length;
+    }
+    return FindInvalidUtf8Scalar(p, end);
+}
+
+#endif
+
+ScanKernels Select()
+{
+#ifdef LOX_X86
+    const CpuFeatures &features = GetCpuFeatures();
+    if (features.avx2)
+    {
+        return {SkipWhitespace<Avx2>, FindLineEnd<Avx2>, FindStringEnd<Avx2>, IdentifierEnd<Avx2>,
+                FindInvalidUtf8<Avx2>};
+    }
+    if (features.sse2)
+    {
+        return {SkipWhitespace<Sse2>, FindLineEnd<Sse2>, FindStringEnd<Sse2>, IdentifierEnd<Sse2>,
+                FindInvalidUtf8<Sse2>};
+    }
+#endif
+    return {SkipWhitespaceScalar, FindLineEndScalar, FindStringEndScalar, IdentifierEndScalar, FindInvalidUtf8Scalar};
+}
+} // namespace
+
+const ScanKernels &ScanKernels::Get()
+{
+    static const ScanKernels kernels = Select();
+    return kernels;
+}
+} // namespace lox
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace lox
+{
+// Bulk character-class kernels behind the Scanner's fast paths. Each one
+// returns a pointer to the first byte at or after `p` that ends the run (or
+// `end`) and, where noted, adds the number of '\n' it stepped over to
+// `*newlines`. Get() picks the AVX2, SSE2 or scalar versions once, based on
+// what the CPU supports.
+struct ScanKernels
+{
+    // spaces, tabs, carriage returns and newlines (counted)
+    const char *(*skip_whitespace)(const char *p, const char *end, size_t *newlines);
+    // the '\n' that ends a // comment
+    const char *(*find_line_end)(const char *p, const char *end);
+    // the closing '"' of a string literal, newlines inside it counted
+    const char *(*find_string_end)(const char *p, const char *end, size_t *newlines);
+    // first byte that is not [A-Za-z0-9_]
+    const char *(*identifier_end)(const char *p, const char *end);
+    // first byte that does not belong to a well-formed UTF-8 sequence
+    const char *(*find_invalid_utf8)(const char *p, const char *end);
+
+    static const ScanKernels &Get();
+};
+} // namespace lox
@@ -1,26 +1,120 @@
 
 #include "scanner.h"
+#include "char_class.h"
 #include "error.h"
 #include "object.h"
+#include "stats.h"
 #include "token.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iterator>
 #include <string>
 
 
 using namespace lox;
 
-std::unordered_map<std::string, Token::Type> Scanner::keywords_ = {
-    {"and", Token::Type::kAnd},     {"class", Token::Type::kClass},   {"else", Token::Type::kElse},
-    {"false", Token::Type::kFalse}, {"for", Token::Type::kFor},       {"fun", Token::Type::kFun},
-    {"if", Token::Type::kIf},       {"nil", Token::Type::kNil},       {"or", Token::Type::kOr},
-    {"print", Token::Type::kPrint}, {"return", Token::Type::kReturn}, {"super", Token::Type::kSuper},
-    {"this", Token::Type::kThis},   {"true", Token::Type::kTrue},     {"var", Token::Type::kVar},
-    {"while", Token::Type::kWhile}};
+namespace
+{
+// below this a source is not worth splitting
+constexpr size_t kMinParallelChunk = size_t(256) << 10;
+
+Token::Type CheckKeyword(
+    const char *text, size_t length, size_t start, const char *rest, size_t rest_length, Token::Type type
+)
+{
+    if (length == start + rest_length && std::memcmp(text + start, rest, rest_length) == 0)
+    {
+        return type;
+    }
+    return Token::Type::kIdentifier;
+}
+
+// switch trie over the first one or two characters, then a single compare of
+// the remainder; no hashing and no temporary string per identifier
+Token::Type KeywordType(const char *text, size_t length)
+{
+    switch (text[0])
+    {
+    case 'a':
+        return CheckKeyword(text, length, 1, "nd", 2, Token::Type::kAnd);
+    case 'c':
+        return CheckKeyword(text, length, 1, "lass", 4, Token::Type::kClass);
+    case 'e':
+        return CheckKeyword(text, length, 1, "lse", 3, Token::Type::kElse);
+    case 'f':
+        if (length > 1)
+        {
+            switch (text[1])
+            {
+            case 'a':
+                return CheckKeyword(text, length, 2, "lse", 3, Token::Type::kFalse);
+            case 'o':
+                return CheckKeyword(text, length, 2, "r", 1, Token::Type::kFor);
+            case 'u':
+                return CheckKeyword(text, length, 2, "n", 1, Token::Type::kFun);
+            }
+        }
+        break;
+    case 'i':
+        if (length > 1)
+        {
+            switch (text[1])
+            {
+            case 'f':
+                return CheckKeyword(text, length, 2, "", 0, Token::Type::kIf);
+            case 'm':
+                return CheckKeyword(text, length, 2, "port", 4, Token::Type::kImport);
+            }
+        }
+        break;
+    case 'n':
+        return CheckKeyword(text, length, 1, "il", 2, Token::Type::kNil);
+    case 'o':
+        return CheckKeyword(text, length, 1, "r", 1, Token::Type::kOr);
+    case 'p':
+        return CheckKeyword(text, length, 1, "rint", 4, Token::Type::kPrint);
+    case 'r':
+        return CheckKeyword(text, length, 1, "eturn", 5, Token::Type::kReturn);
+    case 's':
+        return CheckKeyword(text, length, 1, "uper", 4, Token::Type::kSuper);
+    case 't':
+        if (length > 1)
+        {
+            switch (text[1])
+            {
+            case 'h':
+                return CheckKeyword(text, length, 2, "is", 2, Token::Type::kThis);
+            case 'r':
+                return CheckKeyword(text, length, 2, "ue", 2, Token::Type::kTrue);
+            }
+        }
+        break;
+    case 'v':
+        return CheckKeyword(text, length, 1, "ar", 2, Token::Type::kVar);
+    case 'w':
+        return CheckKeyword(text, length, 1, "hile", 4, Token::Type::kWhile);
+    }
+    return Token::Type::kIdentifier;
+}
+} // namespace
 
+Scanner::Scanner(std::string source)
+    : kernels_(ScanKernels::Get()), owned_source_(std::move(source)), source_(owned_source_)
+{
+}
 
-Scanner::Scanner(const std::string &source) : source_(source) {}
+Scanner::Scanner(std::string_view source, size_t begin, size_t line)
+    : kernels_(ScanKernels::Get()), source_(source), current_(begin), line_(line), validated_(true)
+{
+}
 
 const std::vector<Token> &Scanner::ScanTokens()
 {
+    ValidateEncoding();
+
     while (!IsAtEnd())
     {
         start_ = current_;
@@ -32,6 +126,156 @@ const std::vector<Token> &Scanner::ScanTokens()
     return tokens_;
 }
 
+Token Scanner::NextToken()
+{
+    ValidateEncoding();
+
+    // ScanToken adds at most one token, so tokens_ never holds more than that here
+    while (tokens_.empty())
+    {
+        if (IsAtEnd())
+        {
+            return Token(Token::Type::kEOF, "", nullptr, line_);
+        }
+        start_ = current_;
+        ScanToken();
+    }
+
+    Token token = std::move(tokens_.back());
+    tokens_.pop_back();
+    return token;
+}
+
+struct Scanner::Chunk
+{
+    std::vector<Token> tokens;
+    std::vector<ErrorRecord> errors;
+    // where scanning stopped and the line there
+    size_t end = 0;
+    size_t line = 0;
+};
+
+void Scanner::ScanUntil(size_t limit)
+{
+    while (current_ < limit && !IsAtEnd())
+    {
+        start_ = current_;
+        ScanToken();
+    }
+}
+
+Scanner::Chunk Scanner::ScanChunk(std::string_view source, size_t begin, size_t line, size_t limit)
+{
+    PhaseScope phase(Stats::Phase::kScan);
+    ErrorCapture capture;
+    Scanner scanner(source, begin, line);
+    scanner.ScanUntil(limit);
+    return Chunk{std::move(scanner.tokens_), capture.Take(), scanner.current_, scanner.line_};
+}
+
+// Each chunk starts right after a newline and is scanned speculatively, as if
+// no token were open there. That only fails to hold when the previous chunk's
+// last token (a string literal; comments, names and numbers stop at the newline)
+// ran on past the boundary. Stitching walks the chunks in order and rescans
+// such a chunk from where that token really ended, which also fixes its lines.
+const std::vector<Token> &Scanner::ScanTokensParallel(size_t jobs)
+{
+    jobs = std::min(jobs, source_.size() / kMinParallelChunk);
+    if (jobs < 2)
+    {
+        return ScanTokens();
+    }
+
+    ValidateEncoding();
+
+    std::vector<size_t> bounds{current_};
+    std::vector<size_t> lines{line_};
+    for (size_t i = 1; i < jobs; i++)
+    {
+        size_t split = std::max(bounds.back(), current_ + (source_.size() - current_) * i / jobs);
+        size_t newline = source_.find('\n', split);
+        if (newline == std::string_view::npos)
+        {
+            break;
+        }
+        lines.push_back(lines.back() +
+                        std::count(source_.begin() + bounds.back(), source_.begin() + newline + 1, '\n'));
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(source_.size());
+
+    size_t chunk_count = bounds.size() - 1;
+    std::vector<std::future<Chunk>> pending;
+    for (size_t i = 1; i < chunk_count; i++)
+    {
+        pending.push_back(std::async(std::launch::async, ScanChunk, source_, bounds[i], lines[i], bounds[i + 1]));
+    }
+
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunk_count);
+    chunks.push_back(ScanChunk(source_, bounds[0], lines[0], bounds[1]));
+    for (std::future<Chunk> &chunk : pending)
+    {
+        chunks.push_back(chunk.get());
+    }
+
+    size_t token_count = 0;
+    for (const Chunk &chunk : chunks)
+    {
+        token_count += chunk.tokens.size();
+    }
+    tokens_.reserve(tokens_.size() + token_count + 1);
+
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        if (current_ > bounds[i])
+        {
+            if (current_ >= bounds[i + 1])
+            {
+                // swallowed whole by the previous token
+                continue;
+            }
+            bool whitespace_only = std::all_of(source_.begin() + bounds[i], source_.begin() + current_, [](char c) {
+                return HasCharClass(c, kCharWhitespace);
+            });
+            if (!whitespace_only)
+            {
+                chunks[i] = ScanChunk(source_, current_, line_, bounds[i + 1]);
+            }
+        }
+
+        Chunk &chunk = chunks[i];
+        std::move(chunk.tokens.begin(), chunk.tokens.end(), std::back_inserter(tokens_));
+        for (const ErrorRecord &record : chunk.errors)
+        {
+            Replay(record);
+        }
+        current_ = chunk.end;
+        line_ = chunk.line;
+    }
+
+    tokens_.push_back(Token(Token::Type::kEOF, "", nullptr, line_));
+
+    return tokens_;
+}
+
+// validated up front in one vectorized pass; almost all source is ASCII
+void Scanner::ValidateEncoding()
+{
+    if (validated_)
+    {
+        return;
+    }
+    validated_ = true;
+
+    const char *begin = source_.data();
+    const char *invalid = kernels_.find_invalid_utf8(begin, begin + source_.size());
+    if (invalid != begin + source_.size())
+    {
+        lox::Error(1 + std::count(begin, invalid, '\n'), "Invalid UTF-8 in source.");
+    }
+}
+
 void Scanner::ScanToken()
 {
     const char c = Advance();
@@ -82,22 +326,25 @@ void Scanner::ScanToken()
     case '/':
         if (Match('/'))
         {
-            while (Peek() != '\n' && !IsAtEnd())
-            {
-                Advance();
-            }
+            const char *begin = source_.data();
+            current_ = kernels_.find_line_end(begin + current_, begin + source_.size()) - begin;
         }
         else
         {
             AddToken(Token::Type::kSlash);
         }
+        break;
     case ' ':
     case '\r':
     case '\t':
-        break;
     case '\n':
-        line_++;
+    {
+        const char *begin = source_.data();
+        size_t newlines = 0;
+        current_ = kernels_.skip_whitespace(begin + current_ - 1, begin + source_.size(), &newlines) - begin;
+        line_ += newlines;
         break;
+    }
     case '"':
         string();
         break;
@@ -123,10 +370,10 @@ bool Scanner::IsAtEnd()
     return current_ >= source_.size();
 }
 
+// callers check IsAtEnd() first, so the accessors skip the bounds check of at()
 char Scanner::Advance()
 {
-    current_++;
-    return source_.at(current_ - 1);
+    return source_[current_++];
 }
 
 char Scanner::Peek()
@@ -135,7 +382,7 @@ char Scanner::Peek()
     {
         return '\0';
     }
-    return source_.at(current_);
+    return source_[current_];
 }
 
 char Scanner::PeekNext()
@@ -144,7 +391,7 @@ char Scanner::PeekNext()
     {
         return '\0';
     }
-    return source_.at(current_ + 1);
+    return source_[current_ + 1];
 }
 
 bool Scanner::Match(char expected)
@@ -160,26 +407,22 @@ bool Scanner::Match(char expected)
 
 bool Scanner::IsDigit(char c)
 {
-    return c >= '0' && c <= '9';
+    return HasCharClass(c, kCharDigit);
 }
 
 bool Scanner::IsAlpha(char c)
 {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    return HasCharClass(c, kCharAlpha);
 }
 
 void Scanner::string()
 {
-    while (Peek() != '"' && !IsAtEnd())
-    {
-        if (Peek() == '\n')
-        {
-            line_++;
-        }
-        Advance();
-    }
+    const char *begin = source_.data();
+    size_t newlines = 0;
+    current_ = kernels_.find_string_end(begin + current_, begin + source_.size(), &newlines) - begin;
+    line_ += newlines;
 
-    std::string value = source_.substr(start_ + 1, current_ - (start_ + 1));
+    std::string value(source_.substr(start_ + 1, current_ - (start_ + 1)));
 
     if (IsAtEnd())
     {
@@ -209,26 +452,23 @@ void Scanner::number()
         }
     }
 
-    std::string num_str = source_.substr(start_, current_ - start_);
-    AddToken(Token::Type::kNumber, std::stod(num_str));
+    double value = 0.0;
+    auto [end, error] = std::from_chars(source_.data() + start_, source_.data() + current_, value);
+    if (error == std::errc::result_out_of_range)
+    {
+        // from_chars leaves `value` alone; strtod rounds to infinity, or to
+        // zero for a fraction too small to represent
+        value = std::strtod(std::string(source_.substr(start_, current_ - start_)).c_str(), nullptr);
+    }
+    AddToken(Token::Type::kNumber, value);
 }
 
 void Scanner::identifier()
 {
-    while (IsAlpha(Peek()) || IsDigit(Peek()))
-    {
-        Advance();
-    }
-
-    std::string text = source_.substr(start_, current_ - start_);
-    Token::Type type = Token::Type::kIdentifier;
-    auto type_it = keywords_.find(text);
-    if (type_it != keywords_.end())
-    {
-        type = type_it->second;
-    }
+    const char *begin = source_.data();
+    current_ = kernels_.identifier_end(begin + current_, begin + source_.size()) - begin;
 
-    AddToken(type);
+    AddToken(KeywordType(source_.data() + start_, current_ - start_));
 }
 
 void Scanner::AddToken(Token::Type type)
@@ -238,6 +478,6 @@ void Scanner::AddToken(Token::Type type)
 
 void Scanner::AddToken(Token::Type type, Object literal)
 {
-    std::string text = source_.substr(start_, current_ - start_);
+    std::string text(source_.substr(start_, current_ - start_));
     tokens_.push_back(Token(type, text, literal, line_));
 }
\ No newline at end of file
@@ -1,22 +1,41 @@
 #pragma once
 
-#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "token.h"
 #include "object.h"
+#include "scan_simd.h"
 
 namespace lox
 {
 
-class Scanner
+class Scanner : public TokenSource
 {
   public:
-    Scanner(const std::string &source);
+    Scanner(std::string source);
+    Scanner(const Scanner &) = delete;
+    Scanner &operator=(const Scanner &) = delete;
+
     const std::vector<Token>& ScanTokens();
+    // same result as ScanTokens, with the source split at line boundaries and
+    // the pieces scanned on up to `jobs` threads; small sources are scanned serially
+    const std::vector<Token>& ScanTokensParallel(size_t jobs);
     const std::vector<Token>& tokens() { return tokens_; }
+
+    // on-demand scanning: one token per call instead of the whole source
+    Token NextToken() override;
   private:
+    struct Chunk;
+
+    // a scanner over part of a parent's source, starting at `begin` on `line`
+    Scanner(std::string_view source, size_t begin, size_t line);
+    // scan every token that starts before `limit` (the last one may end past it)
+    void ScanUntil(size_t limit);
+    static Chunk ScanChunk(std::string_view source, size_t begin, size_t line, size_t limit);
+
+    void ValidateEncoding();
     void ScanToken();
 
     bool IsAtEnd();
@@ -36,12 +55,15 @@ class Scanner
     void AddToken(Token::Type type);
     void AddToken(Token::Type type, Object literal);
   private:
-    static std::unordered_map<std::string, Token::Type> keywords_;
-    std::string source_;
+    const ScanKernels &kernels_;
+    std::string owned_source_;
+    // owned_source_, or part of the parent's source for a chunk scanner
+    std::string_view source_;
     std::vector<Token> tokens_;
     size_t start_ = 0;
     size_t current_ = 0;
     size_t line_ = 1;
+    bool validated_ = false;
 };
 
 } // namespace lox
\ No newline at end of file
@@ -0,0 +1,675 @@
+#include "serve.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+namespace lox
+{
+int RunServer(const ServerOptions &)
+{
+    std::cerr << "--serve is not supported on this platform." << std::endl;
+    return 64;
+}
+
+int RunClient(const std::string &, const std::string &, const std::string &)
+{
+    std::cerr << "--connect is not supported on this platform." << std::endl;
+    return 64;
+}
+} // namespace lox
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "output.h"
+#include "snapshot.h"
+
+namespace lox
+{
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+bool StartsWith(const std::string &str, const std::string &prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool WriteAll(int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+bool WriteFrame(int fd, const char *kind, std::string_view payload)
+{
+    std::string frame = std::string(kind) + ' ' + std::to_string(payload.size()) + '\n';
+    frame.append(payload);
+    return WriteAll(fd, frame);
+}
+
+// buffered reads of lines and counted payloads from a socket; reads fail once
+// `deadline` has passed
+class Reader
+{
+  public:
+    explicit Reader(int fd, Clock::time_point deadline = Clock::time_point::max()) : fd_(fd), deadline_(deadline) {}
+
+    // whether a read failed for the deadline
+    bool timed_out() const
+    {
+        return timed_out_;
+    }
+
+    // a line without its '\n'; false at the end of the input or when the
+    // line gets longer than any header
+    bool ReadLine(std::string *line)
+    {
+        line->clear();
+        while (true)
+        {
+            if (position_ == buffer_.size() && !Fill())
+            {
+                return false;
+            }
+            char c = buffer_[position_++];
+            if (c == '\n')
+            {
+                return true;
+            }
+            if (line->size() == kMaxLine)
+            {
+                return false;
+            }
+            *line += c;
+        }
+    }
+
+    bool ReadBytes(size_t size, std::string *data)
+    {
+        data->clear();
+        while (data->size() < size)
+        {
+            if (position_ == buffer_.size() && !Fill())
+            {
+                return false;
+            }
+            size_t take = std::min(size - data->size(), buffer_.size() - position_);
+            data->append(buffer_, position_, take);
+            position_ += take;
+        }
+        return true;
+    }
+
+  private:
+    static constexpr size_t kMaxLine = 256;
+
+    bool Fill()
+    {
+        if (deadline_ != Clock::time_point::max() && !Await())
+        {
+            return false;
+        }
+        char chunk[64 * 1024];
+        ssize_t received;
+        do
+        {
+            received = read(fd_, chunk, sizeof(chunk));
+        } while (received < 0 && errno == EINTR);
+        if (received <= 0)
+        {
+            return false;
+        }
+        buffer_.assign(chunk, static_cast<size_t>(received));
+        position_ = 0;
+        return true;
+    }
+
+    // waits until there is something to read before the deadline
+    bool Await()
+    {
+        while (true)
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - Clock::now()).count();
+            if (remaining <= 0)
+            {
+                timed_out_ = true;
+                return false;
+            }
+            pollfd readable{fd_, POLLIN, 0};
+            int ready = poll(&readable, 1, static_cast<int>(std::min<long long>(remaining, INT_MAX)));
+            if (ready > 0)
+            {
+                return true;
+            }
+            if (ready < 0 && errno != EINTR)
+            {
+                return false;
+            }
+        }
+    }
+
+  private:
+    int fd_;
+    Clock::time_point deadline_;
+    bool timed_out_ = false;
+    std::string buffer_;
+    size_t position_ = 0;
+};
+
+// Sends each error message as an `err` frame: Replay() ends every message
+// with std::endl, which syncs the stream.
+class ErrorFrames : public std::stringbuf
+{
+  public:
+    explicit ErrorFrames(int fd) : fd_(fd) {}
+
+  protected:
+    int sync() override
+    {
+        if (!str().empty())
+        {
+            WriteFrame(fd_, "err", str());
+            str("");
+        }
+        return 0;
+    }
+
+  private:
+    int fd_;
+};
+
+// the status for a request that could not be read
+int RequestError(const Reader &reader, std::ostream &errors)
+{
+    if (reader.timed_out())
+    {
+        errors << "request timed out" << std::endl;
+        return 75;
+    }
+    errors << "malformed request" << std::endl;
+    return 64;
+}
+
+std::string ScriptId(const std::string &source)
+{
+    char id[17];
+    std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(std::hash<std::string>()(source)));
+    return id;
+}
+
+class Server
+{
+  public:
+    explicit Server(const ServerOptions &options) : options_(options) {}
+
+    int Run();
+
+  private:
+    struct Cached
+    {
+        std::string source;
+        Script script;
+        // where its id is in recent_
+        std::list<std::string>::iterator recent;
+    };
+
+    // what the watchdog knows about the request a worker is running
+    struct Slot
+    {
+        Engine *engine = nullptr;
+        Clock::time_point deadline;
+    };
+
+    std::unique_ptr<Engine> NewEngine();
+    void Work(size_t index);
+    // the request on `fd`, answered with everything but its status frame
+    int Handle(int fd, Engine *engine, size_t index);
+    int Execute(Engine *engine, const Script &script, size_t index);
+    // the cached script with `id`, and `source` if there is one; an invalid
+    // script if there is none
+    Script FindScript(const std::string &id, const std::string *source);
+    void CacheScript(const std::string &id, std::string source, const Script &script);
+    // interrupts the requests that are past their deadline
+    void Watch();
+
+  private:
+    const ServerOptions &options_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable watch_;
+    std::deque<int> connections_;
+    std::vector<Slot> slots_;
+    bool stopping_ = false;
+
+    std::mutex scripts_mutex_;
+    std::unordered_map<std::string, Cached> scripts_;
+    // ids of the cached scripts, the most recently used first
+    std::list<std::string> recent_;
+};
+
+std::unique_ptr<Engine> Server::NewEngine()
+{
+    auto engine = std::make_unique<Engine>();
+    if (!options_.snapshot_path.empty())
+    {
+        Snapshot::Restore(engine->interpreter(), options_.snapshot_path);
+    }
+    return engine;
+}
+
+int Server::Run()
+{
+    const std::string &path = options_.socket_path;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "socket path too long: " + path << std::endl;
+        return 64;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // checked once up front; the workers restore it without looking
+    Engine probe;
+    if (!options_.snapshot_path.empty() && !Snapshot::Restore(probe.interpreter(), options_.snapshot_path))
+    {
+        std::cerr << "can not load snapshot: " + options_.snapshot_path << std::endl;
+        return 66;
+    }
+
+    // a socket left behind by an earlier server
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path.c_str());
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        std::cerr << "can not listen on socket: " + path << std::endl;
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        return 74;
+    }
+
+    size_t workers = options_.workers != 0 ? options_.workers : std::max(1u, std::thread::hardware_concurrency());
+    slots_.resize(workers);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++)
+    {
+        threads.emplace_back(&Server::Work, this, i);
+    }
+    std::thread watchdog(&Server::Watch, this);
+
+    int result = 0;
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            std::cerr << "can not accept on socket: " + path << std::endl;
+            result = 74;
+            break;
+        }
+        // a client that stops reading fails the write instead of holding its worker
+        timeval send_timeout{};
+        send_timeout.tv_sec = static_cast<time_t>(options_.client_timeout.count() / 1000);
+        send_timeout.tv_usec = static_cast<suseconds_t>(options_.client_timeout.count() % 1000 * 1000);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.push_back(fd);
+        }
+        ready_.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    watch_.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    watchdog.join();
+    close(listener);
+    unlink(path.c_str());
+    return result;
+}
+
+void Server::Work(size_t index)
+{
+    std::unique_ptr<Engine> next = NewEngine();
+    while (true)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return stopping_ || !connections_.empty(); });
+            if (connections_.empty())
+            {
+                return;
+            }
+            fd = connections_.front();
+            connections_.pop_front();
+        }
+
+        std::unique_ptr<Engine> engine = std::move(next);
+        int status = Handle(fd, engine.get(), index);
+        WriteAll(fd, "status " + std::to_string(status) + "\n");
+        close(fd);
+
+        engine.reset();
+        next = NewEngine();
+    }
+}
+
+int Server::Handle(int fd, Engine *engine, size_t index)
+{
+    ErrorFrames frames(fd);
+    std::ostream errors(&frames);
+    // covers the whole request, however slowly it trickles in
+    Reader reader(fd, Clock::now() + options_.client_timeout);
+    std::string header;
+    if (!reader.ReadLine(&header))
+    {
+        return RequestError(reader, errors);
+    }
+
+    Script script;
+    if (StartsWith(header, "run "))
+    {
+        std::string_view digits = std::string_view(header).substr(std::string("run ").size());
+        size_t length = 0;
+        auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), length);
+        if (error != std::errc() || end != digits.data() + digits.size())
+        {
+            errors << "malformed request" << std::endl;
+            return 64;
+        }
+        if (length > options_.max_request)
+        {
+            errors << "request too large" << std::endl;
+            return 64;
+        }
+        std::string source;
+        if (!reader.ReadBytes(length, &source))
+        {
+            return RequestError(reader, errors);
+        }
+
+        std::string id = ScriptId(source);
+        script = FindScript(id, &source);
+        if (!script.valid())
+        {
+            script = Script::Compile(source, errors);
+            if (!script.valid())
+            {
+                return 65;
+            }
+            CacheScript(id, std::move(source), script);
+        }
+        WriteAll(fd, "id " + id + "\n");
+    }
+    else if (StartsWith(header, "call "))
+    {
+        std::string id = header.substr(std::string("call ").size());
+        script = FindScript(id, nullptr);
+        if (!script.valid())
+        {
+            errors << "unknown script id: " + id << std::endl;
+            return 66;
+        }
+    }
+    else
+    {
+        errors << "malformed request" << std::endl;
+        return 64;
+    }
+
+    Output output([fd](std::string_view text) { return WriteFrame(fd, "out", text); }, Output::FlushPolicy::kLine);
+    engine->set_output(&output, errors);
+    int status = Execute(engine, script, index);
+    output.Flush();
+    return status;
+}
+
+int Server::Execute(Engine *engine, const Script &script, size_t index)
+{
+    if (options_.timeout.count() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[index].engine = engine;
+            slots_[index].deadline = Clock::now() + options_.timeout;
+        }
+        watch_.notify_one();
+    }
+
+    bool succeeded = engine->Execute(script);
+
+    {
+        // once cleared, the watchdog no longer touches the engine
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[index].engine = nullptr;
+    }
+    if (engine->interrupted())
+    {
+        return 75;
+    }
+    if (!succeeded)
+    {
+        return engine->errors().had_runtime_error ? 70 : 65;
+    }
+    return 0;
+}
+
+Script Server::FindScript(const std::string &id, const std::string *source)
+{
+    std::lock_guard<std::mutex> lock(scripts_mutex_);
+    auto it = scripts_.find(id);
+    if (it == scripts_.end() || (source != nullptr && it->second.source != *source))
+    {
+        return Script();
+    }
+    recent_.splice(recent_.begin(), recent_, it->second.recent);
+    return it->second.script;
+}
+
+void Server::CacheScript(const std::string &id, std::string source, const Script &script)
+{
+    std::lock_guard<std::mutex> lock(scripts_mutex_);
+    auto it = scripts_.find(id);
+    if (it != scripts_.end())
+    {
+        // another worker compiled it too, or a source with the same id
+        recent_.erase(it->second.recent);
+        scripts_.erase(it);
+    }
+    recent_.push_front(id);
+    scripts_.emplace(id, Cached{std::move(source), script, recent_.begin()});
+    while (scripts_.size() > options_.cache_size)
+    {
+        // requests running the dropped script keep it alive until they finish
+        scripts_.erase(recent_.back());
+        recent_.pop_back();
+    }
+}
+
+void Server::Watch()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_)
+    {
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = Clock::time_point::max();
+        for (Slot &slot : slots_)
+        {
+            if (slot.engine == nullptr)
+            {
+                continue;
+            }
+            if (slot.deadline <= now)
+            {
+                slot.engine->Interrupt();
+                slot.engine = nullptr;
+            }
+            else
+            {
+                next = std::min(next, slot.deadline);
+            }
+        }
+        if (next == Clock::time_point::max())
+        {
+            watch_.wait(lock);
+        }
+        else
+        {
+            watch_.wait_until(lock, next);
+        }
+    }
+}
+} // namespace
+
+int RunServer(const ServerOptions &options)
+{
+    Server server(options);
+    return server.Run();
+}
+
+int RunClient(const std::string &socket_path, const std::string &script_path, const std::string &script_id)
+{
+    std::string request;
+    if (script_id.empty())
+    {
+        std::ifstream file(script_path);
+        if (!file.is_open())
+        {
+            std::cerr << "can not open file: " + script_path << std::endl;
+            return 66;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        request = "run " + std::to_string(buffer.str().size()) + "\n" + buffer.str();
+    }
+    else
+    {
+        request = "call " + script_id + "\n";
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_path.size() >= sizeof(address.sun_path) || fd < 0)
+    {
+        std::cerr << "can not connect to socket: " + socket_path << std::endl;
+        return 74;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || !WriteAll(fd, request))
+    {
+        std::cerr << "can not connect to socket: " + socket_path << std::endl;
+        close(fd);
+        return 74;
+    }
+
+    Output &out = Output::Standard();
+    Reader reader(fd);
+    std::string header;
+    std::string payload;
+    int status = -1;
+    while (status < 0 && reader.ReadLine(&header))
+    {
+        if (StartsWith(header, "status "))
+        {
+            status = std::atoi(header.c_str() + std::string("status ").size());
+            break;
+        }
+        if (StartsWith(header, "id "))
+        {
+            out.Sync();
+            std::cerr << "script id: " << header.substr(std::string("id ").size()) << std::endl;
+            continue;
+        }
+        bool is_output = StartsWith(header, "out ");
+        if (!is_output && !StartsWith(header, "err "))
+        {
+            break;
+        }
+        size_t length = std::strtoull(header.c_str() + std::string("out ").size(), nullptr, 10);
+        if (!reader.ReadBytes(length, &payload))
+        {
+            break;
+        }
+        if (is_output)
+        {
+            out.Write(payload);
+            out.Sync();
+        }
+        else
+        {
+            out.Sync();
+            std::cerr << payload << std::flush;
+        }
+    }
+    close(fd);
+    if (status < 0)
+    {
+        std::cerr << "connection to the server was lost" << std::endl;
+        return 74;
+    }
+    return status;
+}
+} // namespace lox
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace lox
+{
+// Evaluation server behind --serve=socket: a long-lived process that runs
+// scripts sent over a Unix domain socket, so a request pays neither process
+// startup nor loading the prelude.
+//
+// One request per connection. The client sends one of
+//     run <length>\n<source>    compile and run `source`, caching the script
+//     call <id>\n               run a script cached by an earlier run
+// and the server answers with frames, streamed as the script runs:
+//     id <id>\n                 (run only) the id the script is cached under
+//     out <length>\n<text>      printed output, a line at a time
+//     err <length>\n<text>      one error message
+//     status <code>\n           the last frame: 0, or 64 for a malformed or
+//                               too large request, 65 for a compile error,
+//                               66 for an unknown id, 70 for a runtime error
+//                               and 75 when the request was not sent or did
+//                               not finish in time
+//
+// The server keeps the scripts it compiled for `call`, up to a limit past
+// which the least recently used one is dropped. Every request runs in a fresh
+// context, restored from the snapshot if there is one. A worker prepares its next context while it is idle, so that cost
+// stays off the request path.
+struct ServerOptions
+{
+    std::string socket_path;
+    std::string snapshot_path;
+    // requests run at once; 0 picks one per core
+    size_t workers = 0;
+    // a request still running after this long is interrupted; 0 for never
+    std::chrono::milliseconds timeout{0};
+    // how long a client may take to send its whole request, and each write of
+    // the reply may wait for the client to read
+    std::chrono::milliseconds client_timeout{10000};
+    // scripts kept for `call`
+    size_t cache_size = 1024;
+    // the longest source a `run` may send, in bytes; refused before it is read
+    size_t max_request = 16 << 20;
+};
+
+// serves until the process is killed; returns only if the socket can not be
+// set up or stops accepting connections
+int RunServer(const ServerOptions &options);
+
+// The client behind --connect=socket: runs the script at `script_path`, or
+// the cached `script_id` if there is one, on the server, prints its output
+// and errors and returns its status. The id of a script sent as source is
+// reported on stderr.
+int RunClient(const std::string &socket_path, const std::string &script_path, const std::string &script_id);
+} // namespace lox
@@ -0,0 +1,667 @@
+#include "snapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "array.h"
+#include "ast_serializer.h"
+#include "callable.h"
+#include "instance.h"
+#include "interpreter.h"
+#include "list.h"
+#include "map.h"
+#include "mapped_file.h"
+#include "stats.h"
+
+namespace lox
+{
+namespace
+{
+constexpr char kMagic[4] = {'L', 'O', 'X', 'S'};
+
+struct SnapshotHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t payload_size;
+};
+
+enum class ValueTag : uint8_t
+{
+    kValue,
+    kClosure,
+    kNative,
+    kClass,
+    kInstance,
+    kBoundMethod,
+    kArray,
+    kMap,
+    kList,
+};
+
+// Numbers the heap objects reachable from the globals: closures and their
+// declarations, the cells they share, classes, instances, bound methods,
+// arrays, lists and maps.
+// Cells and fields may hold further objects, so this walks a graph.
+class SnapshotWriter
+{
+  public:
+    void Add(const Object &value)
+    {
+        pending_.push_back(&value);
+        while (!pending_.empty())
+        {
+            const Object *next = pending_.back();
+            pending_.pop_back();
+            Visit(*next);
+        }
+    }
+
+    // everything but the values, so the reader can create every object first
+    void WriteObjects(AstSerializer &serializer)
+    {
+        serializer.WriteVarint(declarations_.size());
+        for (stmt::Function *declaration : declarations_)
+        {
+            serializer.WriteStmt(declaration);
+        }
+        serializer.WriteVarint(cells_.size());
+        serializer.WriteVarint(closures_.size());
+        for (UserDefineCallable *closure : closures_)
+        {
+            serializer.WriteVarint(declaration_ids_.at(closure->declaration()));
+            serializer.WriteByte(closure->initializer() ? 1 : 0);
+            serializer.WriteVarint(closure->upvalues().size());
+            for (const CellPtr &cell : closure->upvalues())
+            {
+                serializer.WriteVarint(cell_ids_.at(cell));
+            }
+        }
+        // a superclass is always numbered before its subclasses
+        serializer.WriteVarint(classes_.size());
+        for (ClassCallable *klass : classes_)
+        {
+            serializer.WriteString(klass->name());
+            serializer.WriteVarint(klass->superclass() != nullptr ? class_ids_.at(klass->superclass()) + 1 : 0);
+            serializer.WriteVarint(klass->methods().size());
+            for (const auto &[name, method] : klass->methods())
+            {
+                serializer.WriteString(name);
+                serializer.WriteVarint(closure_ids_.at(method));
+            }
+        }
+        serializer.WriteVarint(instances_.size());
+        for (Instance *instance : instances_)
+        {
+            serializer.WriteVarint(class_ids_.at(instance->klass()));
+            std::vector<const std::string *> fields = instance->shape()->FieldNames();
+            serializer.WriteVarint(fields.size());
+            for (const std::string *field : fields)
+            {
+                serializer.WriteString(*field);
+            }
+        }
+        serializer.WriteVarint(bound_methods_.size());
+        for (BoundMethod *bound : bound_methods_)
+        {
+            serializer.WriteVarint(instance_ids_.at(bound->receiver()));
+            serializer.WriteVarint(closure_ids_.at(bound->method()));
+        }
+        serializer.WriteVarint(arrays_.size());
+        for (Array *array : arrays_)
+        {
+            serializer.WriteVarint(array->values().size());
+            for (double value : array->values())
+            {
+                serializer.WriteObject(value);
+            }
+        }
+        serializer.WriteVarint(lists_.size());
+        for (List *list : lists_)
+        {
+            serializer.WriteVarint(list->values().size());
+        }
+        serializer.WriteVarint(maps_.size());
+        for (Map *map : maps_)
+        {
+            serializer.WriteVarint(map->size());
+        }
+    }
+
+    void WriteValues(AstSerializer &serializer)
+    {
+        for (Cell *cell : cells_)
+        {
+            WriteValue(serializer, cell->value);
+        }
+        for (Instance *instance : instances_)
+        {
+            for (uint32_t slot = 0; slot < instance->shape()->size(); slot++)
+            {
+                WriteValue(serializer, instance->field(slot));
+            }
+        }
+        for (List *list : lists_)
+        {
+            for (const Object &value : list->values())
+            {
+                WriteValue(serializer, value);
+            }
+        }
+        for (Map *map : maps_)
+        {
+            for (size_t slot = 0; slot < map->capacity(); slot++)
+            {
+                if (map->full(slot))
+                {
+                    serializer.WriteObject(map->key(slot));
+                    WriteValue(serializer, map->value(slot));
+                }
+            }
+        }
+    }
+
+    void WriteValue(AstSerializer &serializer, const Object &value)
+    {
+        if (IsObjectInstance<InstancePtr>(value))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kInstance));
+            serializer.WriteVarint(instance_ids_.at(std::get<InstancePtr>(value)));
+            return;
+        }
+        if (IsObjectInstance<ArrayPtr>(value))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kArray));
+            serializer.WriteVarint(array_ids_.at(std::get<ArrayPtr>(value)));
+            return;
+        }
+        if (IsObjectInstance<ListPtr>(value))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kList));
+            serializer.WriteVarint(list_ids_.at(std::get<ListPtr>(value)));
+            return;
+        }
+        if (IsObjectInstance<MapPtr>(value))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kMap));
+            serializer.WriteVarint(map_ids_.at(std::get<MapPtr>(value)));
+            return;
+        }
+        Callable *callable = IsObjectInstance<CallablePtr>(value) ? std::get<CallablePtr>(value) : nullptr;
+        if (callable == nullptr)
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kValue));
+            serializer.WriteObject(value);
+        }
+        else if (auto *native = dynamic_cast<BuiltinCallable *>(callable))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kNative));
+            serializer.WriteString(native->name());
+        }
+        else if (auto *klass = dynamic_cast<ClassCallable *>(callable))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kClass));
+            serializer.WriteVarint(class_ids_.at(klass));
+        }
+        else if (auto *bound = dynamic_cast<BoundMethod *>(callable))
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kBoundMethod));
+            serializer.WriteVarint(bound_method_ids_.at(bound));
+        }
+        else
+        {
+            serializer.WriteByte(static_cast<uint8_t>(ValueTag::kClosure));
+            serializer.WriteVarint(closure_ids_.at(static_cast<UserDefineCallable *>(callable)));
+        }
+    }
+
+  private:
+    void Visit(const Object &value)
+    {
+        if (IsObjectInstance<InstancePtr>(value))
+        {
+            AddInstance(std::get<InstancePtr>(value));
+        }
+        else if (IsObjectInstance<ArrayPtr>(value))
+        {
+            Array *array = std::get<ArrayPtr>(value);
+            if (array_ids_.emplace(array, arrays_.size()).second)
+            {
+                arrays_.push_back(array);
+            }
+        }
+        else if (IsObjectInstance<ListPtr>(value))
+        {
+            List *list = std::get<ListPtr>(value);
+            if (list_ids_.emplace(list, lists_.size()).second)
+            {
+                lists_.push_back(list);
+                for (const Object &element : list->values())
+                {
+                    pending_.push_back(&element);
+                }
+            }
+        }
+        else if (IsObjectInstance<MapPtr>(value))
+        {
+            AddMap(std::get<MapPtr>(value));
+        }
+        else if (IsObjectInstance<CallablePtr>(value))
+        {
+            Callable *callable = std::get<CallablePtr>(value);
+            if (auto *closure = dynamic_cast<UserDefineCallable *>(callable))
+            {
+                AddClosure(closure);
+            }
+            else if (auto *klass = dynamic_cast<ClassCallable *>(callable))
+            {
+                AddClass(klass);
+            }
+            else if (auto *bound = dynamic_cast<BoundMethod *>(callable))
+            {
+                AddBoundMethod(bound);
+            }
+        }
+    }
+
+    void AddClosure(UserDefineCallable *closure)
+    {
+        if (!closure_ids_.emplace(closure, closures_.size()).second)
+        {
+            return;
+        }
+        closures_.push_back(closure);
+        if (declaration_ids_.emplace(closure->declaration(), declarations_.size()).second)
+        {
+            declarations_.push_back(closure->declaration());
+        }
+        for (const CellPtr &cell : closure->upvalues())
+        {
+            if (cell_ids_.emplace(cell, cells_.size()).second)
+            {
+                cells_.push_back(cell);
+                pending_.push_back(&cell->value);
+            }
+        }
+    }
+
+    void AddClass(ClassCallable *klass)
+    {
+        if (class_ids_.count(klass) != 0)
+        {
+            return;
+        }
+        if (klass->superclass() != nullptr)
+        {
+            AddClass(klass->superclass());
+        }
+        class_ids_.emplace(klass, classes_.size());
+        classes_.push_back(klass);
+        for (const auto &[name, method] : klass->methods())
+        {
+            AddClosure(method);
+        }
+    }
+
+    void AddInstance(Instance *instance)
+    {
+        if (!instance_ids_.emplace(instance, instances_.size()).second)
+        {
+            return;
+        }
+        instances_.push_back(instance);
+        AddClass(instance->klass());
+        for (uint32_t slot = 0; slot < instance->shape()->size(); slot++)
+        {
+            pending_.push_back(&instance->field(slot));
+        }
+    }
+
+    void AddBoundMethod(BoundMethod *bound)
+    {
+        if (!bound_method_ids_.emplace(bound, bound_methods_.size()).second)
+        {
+            return;
+        }
+        bound_methods_.push_back(bound);
+        AddInstance(bound->receiver());
+        AddClosure(bound->method());
+    }
+
+    void AddMap(Map *map)
+    {
+        if (!map_ids_.emplace(map, maps_.size()).second)
+        {
+            return;
+        }
+        maps_.push_back(map);
+        for (size_t slot = 0; slot < map->capacity(); slot++)
+        {
+            if (map->full(slot))
+            {
+                pending_.push_back(&map->value(slot));
+            }
+        }
+    }
+
+  private:
+    std::vector<const Object *> pending_;
+    std::vector<stmt::Function *> declarations_;
+    std::vector<UserDefineCallable *> closures_;
+    std::vector<Cell *> cells_;
+    std::vector<ClassCallable *> classes_;
+    std::vector<Instance *> instances_;
+    std::vector<BoundMethod *> bound_methods_;
+    std::vector<Array *> arrays_;
+    std::vector<List *> lists_;
+    std::vector<Map *> maps_;
+    std::unordered_map<stmt::Function *, uint64_t> declaration_ids_;
+    std::unordered_map<UserDefineCallable *, uint64_t> closure_ids_;
+    std::unordered_map<Cell *, uint64_t> cell_ids_;
+    std::unordered_map<ClassCallable *, uint64_t> class_ids_;
+    std::unordered_map<Instance *, uint64_t> instance_ids_;
+    std::unordered_map<BoundMethod *, uint64_t> bound_method_ids_;
+    std::unordered_map<Array *, uint64_t> array_ids_;
+    std::unordered_map<List *, uint64_t> list_ids_;
+    std::unordered_map<Map *, uint64_t> map_ids_;
+};
+
+// the objects of a snapshot being restored, by id
+struct RestoredObjects
+{
+    std::vector<UserDefineCallable *> closures;
+    std::vector<ClassCallable *> classes;
+    std::vector<Instance *> instances;
+    std::vector<BoundMethod *> bound_methods;
+    std::vector<Array *> arrays;
+    std::vector<List *> lists;
+    std::vector<Map *> maps;
+};
+
+template <typename T>
+T *ReadId(AstDeserializer &reader, const std::vector<T *> &objects)
+{
+    uint64_t id = reader.ReadVarint();
+    if (id >= objects.size())
+    {
+        throw SerializationError();
+    }
+    return objects[id];
+}
+
+using Globals = std::unordered_map<std::string, Object>;
+
+Object ReadValue(AstDeserializer &reader, const RestoredObjects &objects, const Globals &globals)
+{
+    switch (static_cast<ValueTag>(reader.ReadByte()))
+    {
+    case ValueTag::kValue:
+        return reader.ReadObject();
+    case ValueTag::kClosure:
+        return static_cast<CallablePtr>(ReadId(reader, objects.closures));
+    case ValueTag::kNative:
+    {
+        auto native = globals.find(reader.ReadString());
+        if (native == globals.end())
+        {
+            throw SerializationError();
+        }
+        return native->second;
+    }
+    case ValueTag::kClass:
+        return static_cast<CallablePtr>(ReadId(reader, objects.classes));
+    case ValueTag::kInstance:
+        return ReadId(reader, objects.instances);
+    case ValueTag::kBoundMethod:
+        return static_cast<CallablePtr>(ReadId(reader, objects.bound_methods));
+    case ValueTag::kArray:
+        return ReadId(reader, objects.arrays);
+    case ValueTag::kMap:
+        return ReadId(reader, objects.maps);
+    case ValueTag::kList:
+        return ReadId(reader, objects.lists);
+    }
+    throw SerializationError();
+}
+} // namespace
+
+bool Snapshot::Save(Interpreter *interpreter, const std::string &path)
+{
+    std::vector<std::pair<const std::string *, const Object *>> saved;
+    SnapshotWriter writer;
+    for (const auto &[name, value] : interpreter->globals()->values())
+    {
+        // natives under their own name are defined by every Interpreter anyway
+        CallablePtr callable = IsObjectInstance<CallablePtr>(value) ? std::get<CallablePtr>(value) : nullptr;
+        auto *native = dynamic_cast<BuiltinCallable *>(callable);
+        if (native == nullptr || native->name() != name)
+        {
+            saved.emplace_back(&name, &value);
+            writer.Add(value);
+        }
+    }
+
+    AstSerializer serializer;
+    writer.WriteObjects(serializer);
+    writer.WriteValues(serializer);
+    serializer.WriteVarint(saved.size());
+    for (const auto &[name, value] : saved)
+    {
+        serializer.WriteString(*name);
+        writer.WriteValue(serializer, *value);
+    }
+    std::string payload = serializer.Finish();
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kAstFormatVersion;
+    header.payload_size = payload.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(payload.data(), payload.size());
+    file.close();
+    return !file.fail();
+}
+
+bool Snapshot::Restore(Interpreter *interpreter, const std::string &path)
+{
+    MappedFile file(path);
+    std::string_view data = file.data();
+
+    SnapshotHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kAstFormatVersion ||
+        header.payload_size != data.size())
+    {
+        return false;
+    }
+
+    Program declarations;
+    std::vector<std::pair<std::string, Object>> restored;
+    try
+    {
+        AstDeserializer reader(data);
+
+        declarations.resize(reader.ReadCount());
+        for (StmtUniquePtr &declaration : declarations)
+        {
+            declaration = reader.ReadStmt();
+            if (dynamic_cast<stmt::Function *>(declaration.get()) == nullptr)
+            {
+                throw SerializationError();
+            }
+        }
+
+        // values are filled in last: they may refer to any of the objects
+        Heap &heap = interpreter->heap();
+        std::vector<CellPtr> cells(reader.ReadCount());
+        for (CellPtr &cell : cells)
+        {
+            cell = heap.Allocate<Cell>();
+        }
+
+        RestoredObjects objects;
+        objects.closures.resize(reader.ReadCount());
+        for (UserDefineCallable *&closure : objects.closures)
+        {
+            uint64_t declaration = reader.ReadVarint();
+            if (declaration >= declarations.size())
+            {
+                throw SerializationError();
+            }
+            auto *function = static_cast<stmt::Function *>(declarations[declaration].get());
+            bool initializer = reader.ReadByte() != 0;
+            std::vector<CellPtr> upvalues(reader.ReadCount());
+            if (upvalues.size() != function->upvalues().size())
+            {
+                throw SerializationError();
+            }
+            for (CellPtr &upvalue : upvalues)
+            {
+                upvalue = ReadId(reader, cells);
+            }
+            closure = heap.Allocate<UserDefineCallable>(function, std::move(upvalues));
+            closure->set_initializer(initializer);
+            Stats::RecordCallable();
+        }
+
+        objects.classes.resize(reader.ReadCount());
+        for (size_t i = 0; i < objects.classes.size(); i++)
+        {
+            std::string name = reader.ReadString();
+            uint64_t superclass = reader.ReadVarint();
+            if (superclass > i)
+            {
+                throw SerializationError();
+            }
+            ClassCallable *parent = superclass > 0 ? objects.classes[superclass - 1] : nullptr;
+            auto *klass = heap.Allocate<ClassCallable>(name, parent);
+            uint64_t methods = reader.ReadCount();
+            for (uint64_t j = 0; j < methods; j++)
+            {
+                std::string method = reader.ReadString();
+                klass->AddMethod(method, ReadId(reader, objects.closures));
+            }
+            objects.classes[i] = klass;
+        }
+
+        objects.instances.resize(reader.ReadCount());
+        for (Instance *&instance : objects.instances)
+        {
+            Shape *shape = ReadId(reader, objects.classes)->root_shape();
+            instance = heap.Allocate<Instance>(shape);
+            uint64_t fields = reader.ReadCount();
+            for (uint64_t i = 0; i < fields; i++)
+            {
+                const std::string &field = reader.ReadString();
+                if (shape->Find(field) != Shape::kNoSlot)
+                {
+                    throw SerializationError();
+                }
+                shape = shape->AddField(field);
+                instance->AddField(shape, nullptr);
+            }
+        }
+
+        objects.bound_methods.resize(reader.ReadCount());
+        for (BoundMethod *&bound : objects.bound_methods)
+        {
+            Instance *receiver = ReadId(reader, objects.instances);
+            bound = heap.Allocate<BoundMethod>(receiver, ReadId(reader, objects.closures));
+        }
+
+        objects.arrays.resize(reader.ReadCount());
+        for (Array *&array : objects.arrays)
+        {
+            std::vector<double> values(reader.ReadCount());
+            for (double &value : values)
+            {
+                Object number = reader.ReadObject();
+                if (!IsObjectInstance<double>(number))
+                {
+                    throw SerializationError();
+                }
+                value = std::get<double>(number);
+            }
+            array = heap.Allocate<Array>(std::move(values));
+        }
+
+        objects.lists.resize(reader.ReadCount());
+        for (List *&list : objects.lists)
+        {
+            list = heap.Allocate<List>(std::vector<Object>(reader.ReadCount()));
+        }
+
+        std::vector<uint64_t> map_sizes(reader.ReadCount());
+        for (uint64_t &size : map_sizes)
+        {
+            size = reader.ReadCount();
+            objects.maps.push_back(heap.Allocate<Map>());
+        }
+
+        const auto &globals = interpreter->globals()->values();
+        for (CellPtr &cell : cells)
+        {
+            cell->value = ReadValue(reader, objects, globals);
+        }
+        for (Instance *instance : objects.instances)
+        {
+            for (uint32_t slot = 0; slot < instance->shape()->size(); slot++)
+            {
+                instance->field(slot) = ReadValue(reader, objects, globals);
+            }
+        }
+        for (List *list : objects.lists)
+        {
+            for (Object &value : list->values())
+            {
+                value = ReadValue(reader, objects, globals);
+            }
+        }
+        for (size_t i = 0; i < objects.maps.size(); i++)
+        {
+            for (uint64_t j = 0; j < map_sizes[i]; j++)
+            {
+                Object key = reader.ReadObject();
+                if (!Map::IsValidKey(key) || objects.maps[i]->Find(key) != nullptr)
+                {
+                    throw SerializationError();
+                }
+                objects.maps[i]->Insert(key, ReadValue(reader, objects, globals));
+            }
+        }
+
+        uint64_t count = reader.ReadCount();
+        for (uint64_t i = 0; i < count; i++)
+        {
+            std::string name = reader.ReadString();
+            restored.emplace_back(std::move(name), ReadValue(reader, objects, globals));
+        }
+        if (!reader.AtEnd())
+        {
+            return false;
+        }
+    }
+    catch (const SerializationError &)
+    {
+        return false;
+    }
+
+    for (const auto &[name, value] : restored)
+    {
+        interpreter->globals()->Define(name, value);
+    }
+    interpreter->Retain(std::move(declarations));
+    return true;
+}
+} // namespace lox
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+namespace lox
+{
+class Interpreter;
+
+// Startup snapshots behind --make-snapshot=file / --snapshot=file.
+//
+// Save() writes the interpreter's global variables after a prelude has run:
+// plain values as they are, natives by name and closures as their function's
+// AST (one copy per function, however many closures share it) plus the cells
+// they captured. Classes, instances, bound methods, arrays, lists and maps are
+// written as the objects they are made of; anything shared stays shared after
+// Restore().
+// Restore() rebuilds those globals in a fresh interpreter without scanning,
+// parsing or executing the prelude again; the restored ASTs are retained by
+// the interpreter. Both return false when the file can't be written / read or
+// is not a snapshot of this interpreter version, leaving globals untouched.
+class Snapshot
+{
+  public:
+    static bool Save(Interpreter *interpreter, const std::string &path);
+    static bool Restore(Interpreter *interpreter, const std::string &path);
+};
+} // namespace lox
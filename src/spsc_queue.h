@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lox
+{
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. The capacity is rounded up to a power of two; the producer only
+// writes tail_ and the consumer only writes head_, each on its own cache line.
+// Push / Pop wait while the ring is full / empty, which also gives the
+// pipeline its backpressure: they spin briefly, yielding, and then sleep on a
+// condition variable until the other side makes progress. The other side only
+// takes the mutex when it sees a sleeper's flag.
+template <typename T>
+class SpscQueue
+{
+  public:
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // moves from value only on success
+    bool TryPush(T &value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_)
+        {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T &value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Push(T value)
+    {
+        Wait(producer_waiting_, [&]() { return TryPush(value); });
+        Wake(consumer_waiting_);
+    }
+
+    T Pop()
+    {
+        T value;
+        Wait(consumer_waiting_, [&]() { return TryPop(value); });
+        Wake(producer_waiting_);
+        return value;
+    }
+
+  private:
+    static constexpr int kSpins = 64;
+
+    template <typename Attempt>
+    void Wait(std::atomic<bool> &waiting, Attempt attempt)
+    {
+        for (int i = 0; i < kSpins; i++)
+        {
+            if (attempt())
+            {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            waiting.store(true, std::memory_order_relaxed);
+            // pairs with the fence in Wake(): either this attempt sees the other
+            // side's progress or the other side sees the flag
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (attempt())
+            {
+                break;
+            }
+            wakeup_.wait(lock);
+        }
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    void Wake(std::atomic<bool> &waiting)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wakeup_.notify_all();
+        }
+    }
+
+  private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<bool> producer_waiting_{false};
+    std::atomic<bool> consumer_waiting_{false};
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+};
+} // namespace lox
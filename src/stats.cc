@@ -0,0 +1,167 @@
+#include "stats.h"
+
+#include <iostream>
+
+#include "callable.h"
+#include "error.h"
+#include "interpreter.h"
+#include "lox.h"
+
+namespace lox
+{
+namespace
+{
+constexpr const char *kPhaseNames[] = {"startup", "scan", "parse", "execute"};
+} // namespace
+
+bool Stats::enabled_ = false;
+std::atomic<bool> Stats::tracking_{false};
+thread_local Stats::Phase Stats::phase_ = Stats::Phase::kStartup;
+thread_local int Stats::thread_tracking_ = 0;
+thread_local uint64_t Stats::thread_allocations_ = 0;
+Stats::PhaseCounters Stats::phases_[static_cast<size_t>(Phase::kCount)];
+std::atomic<int64_t> Stats::live_bytes_{0};
+std::atomic<int64_t> Stats::peak_live_bytes_{0};
+std::atomic<uint64_t> Stats::frames_{0};
+std::atomic<uint64_t> Stats::cells_{0};
+std::atomic<uint64_t> Stats::callables_{0};
+std::atomic<uint64_t> Stats::global_lookups_{0};
+std::atomic<uint64_t> Stats::cache_hits_{0};
+std::atomic<uint64_t> Stats::cache_misses_{0};
+std::atomic<uint64_t> Stats::minor_collections_{0};
+std::atomic<uint64_t> Stats::major_collections_{0};
+std::atomic<uint64_t> Stats::gc_freed_bytes_{0};
+std::atomic<uint64_t> Stats::gc_pause_nanos_{0};
+std::atomic<uint64_t> Stats::gc_max_pause_nanos_{0};
+
+void Stats::Enable()
+{
+    enabled_ = true;
+    SetTracking(true);
+}
+
+void Stats::RecordAllocation(size_t bytes)
+{
+    thread_allocations_++;
+    PhaseCounters &counters = phases_[static_cast<size_t>(phase_)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    int64_t live = live_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = peak_live_bytes_.load(std::memory_order_relaxed);
+    while (live > peak && !peak_live_bytes_.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Stats::RecordDeallocation(size_t bytes)
+{
+    live_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void Stats::RecordCollection(bool major, double seconds, size_t freed_bytes)
+{
+    (major ? major_collections_ : minor_collections_).fetch_add(1, std::memory_order_relaxed);
+    gc_freed_bytes_.fetch_add(freed_bytes, std::memory_order_relaxed);
+    auto nanos = static_cast<uint64_t>(seconds * 1e9);
+    gc_pause_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t max = gc_max_pause_nanos_.load(std::memory_order_relaxed);
+    while (nanos > max && !gc_max_pause_nanos_.compare_exchange_weak(max, nanos, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t Stats::allocations()
+{
+    uint64_t total = 0;
+    for (const PhaseCounters &counters : phases_)
+    {
+        total += counters.allocations.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Stats::Report(std::ostream &out)
+{
+    out << "== stats ==\n";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::kCount); i++)
+    {
+        out << kPhaseNames[i] << ": " << phases_[i].allocations.load() << " allocations, " << phases_[i].bytes.load()
+            << " bytes\n";
+    }
+    out << "peak live bytes: " << peak_live_bytes_.load() << "\n";
+    out << "call frames pushed: " << frames_.load() << "\n";
+    out << "cells allocated: " << cells_.load() << "\n";
+    out << "functions created: " << callables_.load() << "\n";
+    out << "global lookups: " << global_lookups_.load() << "\n";
+    out << "compile cache: " << cache_hits_.load() << " hits, " << cache_misses_.load() << " misses\n";
+    out << "gc: " << minor_collections_.load() << " minor, " << major_collections_.load() << " major collections, "
+        << gc_freed_bytes_.load() << " bytes freed, pause total " << gc_pause_nanos_.load() / 1e6 << " ms, max "
+        << gc_max_pause_nanos_.load() / 1e6 << " ms" << std::endl;
+}
+
+void Stats::ReportJson(std::ostream &out)
+{
+    out << "{\"phases\": {";
+    for (size_t i = 0; i < static_cast<size_t>(Phase::kCount); i++)
+    {
+        out << (i > 0 ? ", " : "") << "\"" << kPhaseNames[i]
+            << "\": {\"allocations\": " << phases_[i].allocations.load()
+            << ", \"bytes\": " << phases_[i].bytes.load() << "}";
+    }
+    out << "}, \"peak_live_bytes\": " << peak_live_bytes_.load() << ", \"frames\": " << frames_.load()
+        << ", \"cells\": " << cells_.load() << ", \"functions\": " << callables_.load()
+        << ", \"global_lookups\": " << global_lookups_.load() << ", \"compile_cache\": {\"hits\": " << cache_hits_.load() << ", \"misses\": " << cache_misses_.load()
+        << "}, \"gc\": {\"minor\": " << minor_collections_.load() << ", \"major\": " << major_collections_.load()
+        << ", \"freed_bytes\": " << gc_freed_bytes_.load() << ", \"pause_ns\": " << gc_pause_nanos_.load()
+        << ", \"max_pause_ns\": " << gc_max_pause_nanos_.load() << "}}" << std::endl;
+}
+
+Object AssertNoAllocFunc(Interpreter *interpreter, const std::vector<Object> &arguments)
+{
+    if (!IsObjectInstance<CallablePtr>(arguments.at(0)) || std::get<CallablePtr>(arguments.at(0))->arity() != 0)
+    {
+        throw NativeError("assertNoAlloc() expects a function taking no arguments.");
+    }
+    CallablePtr function = std::get<CallablePtr>(arguments.at(0));
+
+    // what a call costs by itself, whatever the call path does
+    static const Program kEmpty = Lox::Compile("fun empty() {}");
+    UserDefineCallable empty(static_cast<stmt::Function *>(kEmpty.front().get()));
+
+    // a collection that is due would otherwise run, and allocate, inside the region
+    if (interpreter->heap().collection_due())
+    {
+        interpreter->CollectGarbage();
+    }
+
+    static const std::vector<Object> kNoArguments;
+    Stats::BeginThreadTracking();
+    uint64_t before = Stats::thread_allocations();
+    Object result;
+    uint64_t overhead;
+    try
+    {
+        empty.Call(interpreter, kNoArguments);
+        overhead = Stats::thread_allocations() - before;
+        before = Stats::thread_allocations();
+        result = function->Call(interpreter, kNoArguments);
+    }
+    catch (...)
+    {
+        Stats::EndThreadTracking();
+        throw;
+    }
+    uint64_t calls = Stats::thread_allocations() - before;
+    Stats::EndThreadTracking();
+
+    uint64_t allocated = calls > overhead ? calls - overhead : 0;
+    if (allocated > 0)
+    {
+        throw NativeError(
+            function->ToString() + " allocated " + std::to_string(allocated) + " times in a no-allocation region."
+        );
+    }
+    return result;
+}
+} // namespace lox
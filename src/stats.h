@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "object.h"
+
+namespace lox
+{
+class Interpreter;
+
+// Allocation and runtime counters behind --stats / --stats-json.
+//
+// The global operator new / delete in allocation_hooks.cc feed RecordAllocation
+// and RecordDeallocation with the bytes malloc set aside for each block,
+// attributing every allocation to the current phase. They are part of
+// lox-cpp, not of the library. Counting only happens while
+// tracking is on, for the process or for the calling thread, so the hooks cost
+// two loads otherwise.
+class Stats
+{
+  public:
+    enum class Phase
+    {
+        kStartup,
+        kScan,
+        kParse,
+        kExecute,
+        kCount
+    };
+
+    static void Enable();
+
+    static bool enabled()
+    {
+        return enabled_;
+    }
+
+    static bool tracking()
+    {
+        return tracking_.load(std::memory_order_relaxed) || thread_tracking_ > 0;
+    }
+
+    static void SetTracking(bool tracking)
+    {
+        tracking_.store(tracking, std::memory_order_relaxed);
+    }
+
+    static Phase phase()
+    {
+        return phase_;
+    }
+
+    static void SetPhase(Phase phase)
+    {
+        phase_ = phase;
+    }
+
+    // tracks the calling thread's allocations, even while tracking is off, until
+    // the matching EndThreadTracking()
+    static void BeginThreadTracking()
+    {
+        thread_tracking_++;
+    }
+
+    static void EndThreadTracking()
+    {
+        thread_tracking_--;
+    }
+
+    // allocations counted on the calling thread
+    static uint64_t thread_allocations()
+    {
+        return thread_allocations_;
+    }
+
+    static void RecordAllocation(size_t bytes);
+    static void RecordDeallocation(size_t bytes);
+
+    // a user function's call frame pushed on the interpreter's stacks
+    static void RecordFrame()
+    {
+        if (tracking())
+        {
+            frames_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // a heap cell for a local that a closure captures
+    static void RecordCell()
+    {
+        if (tracking())
+        {
+            cells_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void RecordCallable()
+    {
+        if (tracking())
+        {
+            callables_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // a variable read by name from the globals; locals are read from slots
+    static void RecordGlobalLookup()
+    {
+        if (tracking())
+        {
+            global_lookups_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void RecordCacheLookup(bool hit)
+    {
+        (hit ? cache_hits_ : cache_misses_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // one garbage collection: its pause and the heap bytes it freed
+    static void RecordCollection(bool major, double seconds, size_t freed_bytes);
+
+    static uint64_t allocations();
+
+    static void Report(std::ostream &out);
+    static void ReportJson(std::ostream &out);
+
+  private:
+    struct PhaseCounters
+    {
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    static bool enabled_;
+    static std::atomic<bool> tracking_;
+    static thread_local Phase phase_;
+    static thread_local int thread_tracking_;
+    static thread_local uint64_t thread_allocations_;
+    static PhaseCounters phases_[static_cast<size_t>(Phase::kCount)];
+    static std::atomic<int64_t> live_bytes_;
+    static std::atomic<int64_t> peak_live_bytes_;
+    static std::atomic<uint64_t> frames_;
+    static std::atomic<uint64_t> cells_;
+    static std::atomic<uint64_t> callables_;
+    static std::atomic<uint64_t> global_lookups_;
+    static std::atomic<uint64_t> cache_hits_;
+    static std::atomic<uint64_t> cache_misses_;
+    static std::atomic<uint64_t> minor_collections_;
+    static std::atomic<uint64_t> major_collections_;
+    static std::atomic<uint64_t> gc_freed_bytes_;
+    static std::atomic<uint64_t> gc_pause_nanos_;
+    static std::atomic<uint64_t> gc_max_pause_nanos_;
+};
+
+class PhaseScope
+{
+  public:
+    PhaseScope(Stats::Phase phase) : previous_(Stats::phase())
+    {
+        Stats::SetPhase(phase);
+    }
+
+    ~PhaseScope()
+    {
+        Stats::SetPhase(previous_);
+    }
+
+  private:
+    Stats::Phase previous_;
+};
+
+// assertNoAlloc(fn): calls the zero-argument function `fn` and raises a runtime
+// error if its body allocated anything. Only the calling thread's allocations
+// count, less those of calling an empty function the same way, which are
+// measured next to it; cells of captured variables do count. Marks hot loops
+// that are expected to run allocation free.
+Object AssertNoAllocFunc(Interpreter *interpreter, const std::vector<Object> &arguments);
+} // namespace lox
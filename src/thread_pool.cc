@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace lox
+{
+namespace
+{
+// the pool and worker the current thread belongs to, if any
+thread_local ThreadPool *current_pool = nullptr;
+thread_local size_t current_worker = 0;
+} // namespace
+
+size_t ThreadPool::shared_threads = 0;
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; i++)
+    {
+        threads_.emplace_back(&ThreadPool::Run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+ThreadPool &ThreadPool::Shared()
+{
+    static ThreadPool pool(shared_threads != 0 ? shared_threads : std::thread::hardware_concurrency());
+    return pool;
+}
+
+void ThreadPool::Submit(Task task)
+{
+    size_t index = current_pool == this ? current_worker : next_worker_.fetch_add(1) % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // under the lock, so a worker about to sleep cannot miss it
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        queued_++;
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::Take(size_t index, Task *task)
+{
+    {
+        Worker &own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            *task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); i++)
+    {
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::RunPending()
+{
+    Task task;
+    if (queued_.load() == 0 || !Take(current_pool == this ? current_worker : 0, &task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::Run(size_t index)
+{
+    current_pool = this;
+    current_worker = index;
+    for (;;)
+    {
+        Task task;
+        if (Take(index, &task))
+        {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return queued_.load() != 0 || stopping_; });
+        if (stopping_ && queued_.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+TaskGroup::~TaskGroup()
+{
+    // a group must not outlive its tasks, even when unwinding
+    Join();
+}
+
+void TaskGroup::Run(std::function<void()> task)
+{
+    pending_++;
+    pool_.Submit([this, task = std::move(task)]() mutable {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (error_ == nullptr)
+            {
+                error_ = std::current_exception();
+            }
+        }
+        // nothing of the task may be left once Wait() can return
+        task = nullptr;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0)
+        {
+            done_.notify_all();
+        }
+    });
+}
+
+void TaskGroup::Join()
+{
+    while (pending_.load() != 0)
+    {
+        if (pool_.RunPending())
+        {
+            continue;
+        }
+        // everything left is running elsewhere; recheck now and then in case
+        // those tasks queue more
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait_for(lock, std::chrono::milliseconds(1), [this] { return pending_.load() == 0; });
+    }
+    // the last task may still be inside its notify
+    std::lock_guard<std::mutex> lock(mutex_);
+}
+
+void TaskGroup::Wait()
+{
+    Join();
+    if (error_ != nullptr)
+    {
+        std::exception_ptr error = std::move(error_);
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+} // namespace lox
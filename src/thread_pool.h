@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lox
+{
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back (newest first, so nested fork-join work stays hot
+// in its cache) and, when that runs dry, steals the oldest task from the
+// front of another worker's deque. Tasks submitted from other threads are
+// dealt round-robin. Idle workers sleep until something is queued.
+//
+// Tasks run C++ only: an Interpreter and its heap belong to one thread, so
+// a task may evaluate Lox code only on an Interpreter it creates itself.
+class ThreadPool
+{
+  public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads);
+    // runs what is still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const
+    {
+        return threads_.size();
+    }
+
+    void Submit(Task task);
+
+    // runs one queued task on the calling thread; false if there was none
+    bool RunPending();
+
+    // process-wide pool, started on first use with `shared_threads` workers
+    static ThreadPool &Shared();
+    // set from the command line before anything runs; 0 picks one per core
+    static size_t shared_threads;
+
+  private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void Run(size_t index);
+    // own work first, then the other workers' oldest
+    bool Take(size_t index, Task *task);
+
+  private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_worker_{0};
+    std::atomic<size_t> queued_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+// Fork-join over a pool: Run() queues tasks, Wait() returns once all of them
+// have finished, running queued tasks itself instead of blocking, which keeps
+// nested groups from deadlocking. The first exception a task throws is
+// rethrown by Wait().
+class TaskGroup
+{
+  public:
+    explicit TaskGroup(ThreadPool &pool) : pool_(pool) {}
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void Run(std::function<void()> task);
+    void Wait();
+
+  private:
+    void Join();
+
+  private:
+    ThreadPool &pool_;
+    std::atomic<size_t> pending_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::exception_ptr error_;
+};
+} // namespace lox
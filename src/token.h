@@ -47,6 +47,7 @@ class Token
         kFun,    // FUN
         kFor,    // FOR
         kIf,     // IF
+        kImport, // IMPORT
         kNil,    // NIL
         kOr,     // OR
         kPrint,  // PRINT
@@ -96,4 +97,13 @@ class Token
     size_t line_;
 };
 
+// pull interface for parsing while tokens are still being produced; once the
+// input is exhausted every call returns an EOF token
+class TokenSource
+{
+  public:
+    virtual ~TokenSource() = default;
+    virtual Token NextToken() = 0;
+};
+
 } // namespace lox
\ No newline at end of file
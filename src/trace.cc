@@ -0,0 +1,98 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace lox
+{
+namespace
+{
+uint32_t ThreadIndex()
+{
+    static std::atomic<uint32_t> next_thread{1};
+    thread_local uint32_t index = next_thread.fetch_add(1);
+    return index;
+}
+
+void WriteEscaped(std::ostream &out, const char *str)
+{
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            out << '\\';
+        }
+        out << *str;
+    }
+}
+} // namespace
+
+bool Trace::enabled_ = false;
+bool Trace::calls_enabled_ = false;
+std::string Trace::output_path_;
+Trace::Clock::time_point Trace::origin_;
+Trace::Event *Trace::events_ = nullptr;
+std::atomic<uint64_t> Trace::next_{0};
+
+void Trace::Start(const std::string &output_path, bool calls)
+{
+    output_path_ = output_path;
+    events_ = new Event[kCapacity];
+    origin_ = Clock::now();
+    calls_enabled_ = calls;
+    enabled_ = true;
+}
+
+void Trace::Record(const char *category, std::string_view name, Clock::time_point begin, Clock::time_point end)
+{
+    Event &event = events_[next_.fetch_add(1, std::memory_order_relaxed) % kCapacity];
+    event.category = category;
+    event.begin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin_).count();
+    event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    event.thread = ThreadIndex();
+    size_t length = std::min(name.size(), kMaxNameLength);
+    std::memcpy(event.name, name.data(), length);
+    event.name[length] = '\0';
+}
+
+void Trace::Stop()
+{
+    if (!enabled_)
+    {
+        return;
+    }
+    enabled_ = false;
+    calls_enabled_ = false;
+
+    std::ofstream file(output_path_);
+    if (!file.is_open())
+    {
+        std::cerr << "can not open file: " + output_path_ << std::endl;
+        return;
+    }
+
+    uint64_t recorded = next_.load();
+    uint64_t first = recorded > kCapacity ? recorded - kCapacity : 0;
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (uint64_t i = first; i < recorded; i++)
+    {
+        const Event &event = events_[i % kCapacity];
+        file << (i > first ? ",\n" : "\n") << "{\"name\":\"";
+        WriteEscaped(file, event.name);
+        file << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":" << event.begin_ns / 1000.0
+             << ",\"dur\":" << event.duration_ns / 1000.0 << ",\"pid\":1,\"tid\":" << event.thread << "}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    if (first > 0)
+    {
+        std::cerr << "trace: ring buffer wrapped, " << first << " oldest events dropped" << std::endl;
+    }
+
+    delete[] events_;
+    events_ = nullptr;
+}
+} // namespace lox
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace lox
+{
+// Chrome / Perfetto trace-event recorder behind --trace-out=file.
+//
+// Spans are recorded as complete ("X") events into a ring buffer that is
+// allocated once at Start() and only serialized by Stop(), so tracing does no
+// I/O while the script runs. When the ring wraps the oldest spans are lost,
+// never half of one. Function call spans are only recorded with --trace-calls.
+class Trace
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static void Start(const std::string &output_path, bool calls);
+    static void Stop();
+
+    static bool enabled()
+    {
+        return enabled_;
+    }
+
+    static bool calls_enabled()
+    {
+        return calls_enabled_;
+    }
+
+    static void Record(const char *category, std::string_view name, Clock::time_point begin, Clock::time_point end);
+
+  private:
+    static constexpr size_t kCapacity = size_t(1) << 18;
+    static constexpr size_t kMaxNameLength = 47;
+
+    struct Event
+    {
+        const char *category;
+        int64_t begin_ns;
+        int64_t duration_ns;
+        uint32_t thread;
+        char name[kMaxNameLength + 1];
+    };
+
+    static bool enabled_;
+    static bool calls_enabled_;
+    static std::string output_path_;
+    static Clock::time_point origin_;
+    static Event *events_;
+    static std::atomic<uint64_t> next_;
+};
+
+class TraceScope
+{
+  public:
+    TraceScope(const char *category, std::string_view name, bool active = Trace::enabled())
+        : active_(active), category_(category), name_(name)
+    {
+        if (active_)
+        {
+            begin_ = Trace::Clock::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (active_)
+        {
+            Trace::Record(category_, name_, begin_, Trace::Clock::now());
+        }
+    }
+
+  private:
+    bool active_;
+    const char *category_;
+    std::string_view name_;
+    Trace::Clock::time_point begin_;
+};
+} // namespace lox
@@ -0,0 +1,45 @@
+# Runs lox-cpp and checks what it prints and returns, for the tests in
+# tests/CMakeLists.txt:
+#
+#   cmake -DLOX=lox-cpp -DARGS=flags -DSCRIPTS=scripts -DEXPECTED=file
+#         [-DERRORS=file] [-DSTATUS=code] [-DRUNS=n] [-DCLEAN=dir] -P run_script.cmake
+#
+# ARGS and SCRIPTS separate their items with '|'. Standard error has to match
+# ERRORS, or be empty without it. Every one of the RUNS runs is checked, after
+# CLEAN is removed once before the first.
+
+if(NOT DEFINED STATUS)
+    set(STATUS 0)
+endif()
+if(NOT DEFINED RUNS)
+    set(RUNS 1)
+endif()
+if(DEFINED CLEAN)
+    file(REMOVE_RECURSE "${CLEAN}")
+endif()
+
+string(REPLACE "|" ";" args "${ARGS}")
+string(REPLACE "|" ";" scripts "${SCRIPTS}")
+file(READ "${EXPECTED}" expected_output)
+set(expected_errors "")
+if(DEFINED ERRORS)
+    file(READ "${ERRORS}" expected_errors)
+endif()
+
+foreach(run RANGE 1 ${RUNS})
+    execute_process(
+        COMMAND "${LOX}" ${args} ${scripts}
+        RESULT_VARIABLE status
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+    )
+    if(NOT output STREQUAL expected_output)
+        message(FATAL_ERROR "run ${run}: the output differs from ${EXPECTED}:\n${output}")
+    endif()
+    if(NOT errors STREQUAL expected_errors)
+        message(FATAL_ERROR "run ${run}: unexpected errors:\n${errors}")
+    endif()
+    if(NOT status STREQUAL STATUS)
+        message(FATAL_ERROR "run ${run}: exit status ${status} instead of ${STATUS}")
+    endif()
+endforeach()
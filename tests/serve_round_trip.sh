@@ -0,0 +1,48 @@
+#!/bin/sh
+# Starts lox-cpp --serve, runs a script on it with --connect, then runs it
+# again by the id the first run reported; both must print `expected`.
+#
+# usage: serve_round_trip.sh lox-cpp script expected work-dir
+set -u
+lox=$1
+script=$2
+expected=$3
+dir=$4
+
+rm -rf "$dir"
+mkdir -p "$dir"
+socket="$dir/lox.sock"
+"$lox" --serve="$socket" --serve-workers=2 &
+server=$!
+trap 'kill $server 2>/dev/null' EXIT
+
+tries=0
+while [ ! -S "$socket" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ]; then
+        echo "the server did not start"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+check() {
+    if ! "$lox" --connect="$socket" "$@" >"$dir/out" 2>"$dir/err"; then
+        echo "--connect $* failed:"
+        cat "$dir/err"
+        exit 1
+    fi
+    if ! cmp -s "$expected" "$dir/out"; then
+        echo "--connect $* printed:"
+        cat "$dir/out"
+        exit 1
+    fi
+}
+
+check "$script"
+id=$(sed -n 's/^script id: //p' "$dir/err")
+if [ -z "$id" ]; then
+    echo "no script id reported"
+    exit 1
+fi
+check --script-id="$id"